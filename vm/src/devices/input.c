@@ -0,0 +1,67 @@
+#include "devices/input.h"
+#include <debug.h>
+#include "devices/intq.h"
+#include "devices/serial.h"
+#include "threads/interrupt.h"
+
+/* Stores keys from the keyboard and serial port. */
+static struct intq buffer;
+
+/* Initializes the input buffer. */
+void
+input_init (void)
+{
+  intq_init (&buffer);
+}
+
+/* Adds a key to the input buffer.
+   Interrupts must be off and the buffer must not be full. */
+void
+input_putc (uint8_t key)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!intq_full (&buffer));
+
+  intq_putc (&buffer, key);
+  serial_notify ();
+}
+
+/* Retrieves a key from the input buffer.
+   If the buffer is empty, waits for a key to be pressed. */
+uint8_t
+input_getc (void)
+{
+  uint8_t key;
+
+  input_read (&key, 1);
+  return key;
+}
+
+/* Retrieves up to SIZE keys from the input buffer into KEYS and
+   returns the number retrieved, waiting only if no key at all is
+   available.  Lets console readers drain a burst of input in one
+   call instead of a call per key. */
+size_t
+input_read (uint8_t *keys, size_t size)
+{
+  enum intr_level old_level;
+  size_t n;
+
+  n = intq_read (&buffer, keys, size);
+
+  /* Let the serial layer know we made room, so it can re-enable
+     the receive interrupt if it had to throttle. */
+  old_level = intr_disable ();
+  serial_notify ();
+  intr_set_level (old_level);
+
+  return n;
+}
+
+/* Returns true if the input buffer is full,
+   false otherwise. */
+bool
+input_full (void)
+{
+  return intq_full (&buffer);
+}
@@ -0,0 +1,156 @@
+#include "devices/intq.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Interrupt queues as single-producer/single-consumer rings.
+
+   Each queue moves bytes in one direction between a kernel
+   thread and an external interrupt handler: the keyboard and
+   serial input queues are filled at interrupt level and drained
+   by threads, and the serial output queue the reverse.  The
+   interrupt-level endpoint is serialized by the interrupt
+   controller, and the thread-side endpoint by a lock that the
+   interrupt side never takes.  Every queue therefore has exactly
+   one producer and one consumer at a time, and the data path
+   needs no lock and no interrupt disabling: the producer stores
+   the byte and then publishes it by advancing `tail' behind a
+   barrier; the consumer reads `tail' and then the byte, and
+   releases the slot by advancing `head'.  Indices run freely and
+   are reduced modulo INTQ_BUFSIZE, a power of 2, only to index
+   the buffer.  (On a uniprocessor, compiler barriers are all the
+   ordering the two endpoints need; a multiprocessor port would
+   make `head' and `tail' atomic with acquire/release ordering.)
+
+   Only sleeping, the slow path, involves the scheduler.  A
+   thread that finds the queue empty (consumer) or full
+   (producer) raises its waiting flag, re-checks, and sleeps on a
+   semaphore; the opposite endpoint checks the flag after moving
+   a byte and posts a wakeup token.  A token posted to an
+   endpoint that re-checked in time just causes one spurious
+   wakeup and re-check later; a wakeup can never be lost. */
+
+/* Initializes Q as an empty interrupt queue. */
+void
+intq_init (struct intq *q)
+{
+  q->head = q->tail = 0;
+  lock_init (&q->consumer_lock);
+  lock_init (&q->producer_lock);
+  q->consumer_waiting = q->producer_waiting = false;
+  sema_init (&q->not_empty, 0);
+  sema_init (&q->not_full, 0);
+}
+
+/* Returns true if Q is empty, false otherwise. */
+bool
+intq_empty (const struct intq *q)
+{
+  barrier ();
+  return q->head == q->tail;
+}
+
+/* Returns true if Q is full, false otherwise. */
+bool
+intq_full (const struct intq *q)
+{
+  barrier ();
+  return q->tail - q->head >= INTQ_BUFSIZE;
+}
+
+/* Removes a byte from Q and returns it.  From thread context,
+   blocks until a byte is available; from an interrupt handler, Q
+   must not be empty. */
+uint8_t
+intq_getc (struct intq *q)
+{
+  uint8_t byte;
+
+  intq_read (q, &byte, 1);
+  return byte;
+}
+
+/* Removes up to SIZE bytes from Q into BUF and returns the
+   number removed, at least 1: the first byte is waited for, the
+   rest are taken only if already queued, so a burst of input
+   drains in a single call.  From an interrupt handler, Q must
+   not be empty and no waiting occurs. */
+size_t
+intq_read (struct intq *q, uint8_t *buf, size_t size)
+{
+  bool in_intr = intr_context ();
+  size_t n = 0;
+
+  ASSERT (size > 0);
+
+  if (!in_intr)
+    lock_acquire (&q->consumer_lock);
+
+  /* Wait for the first byte. */
+  while (intq_empty (q))
+    {
+      ASSERT (!in_intr);
+      q->consumer_waiting = true;
+      barrier ();
+      if (intq_empty (q))
+        sema_down (&q->not_empty);
+      q->consumer_waiting = false;
+    }
+
+  while (n < size && !intq_empty (q))
+    {
+      buf[n++] = q->buf[q->head % INTQ_BUFSIZE];
+      barrier ();               /* Read the byte, then free the slot. */
+      q->head++;
+    }
+
+  /* Wake a producer stalled on a full queue. */
+  barrier ();
+  if (q->producer_waiting)
+    {
+      q->producer_waiting = false;
+      sema_up (&q->not_full);
+    }
+
+  if (!in_intr)
+    lock_release (&q->consumer_lock);
+  return n;
+}
+
+/* Adds BYTE to the end of Q.  From thread context, blocks until
+   the queue has room; from an interrupt handler, Q must not be
+   full. */
+void
+intq_putc (struct intq *q, uint8_t byte)
+{
+  bool in_intr = intr_context ();
+
+  if (!in_intr)
+    lock_acquire (&q->producer_lock);
+
+  /* Wait for a free slot. */
+  while (intq_full (q))
+    {
+      ASSERT (!in_intr);
+      q->producer_waiting = true;
+      barrier ();
+      if (intq_full (q))
+        sema_down (&q->not_full);
+      q->producer_waiting = false;
+    }
+
+  q->buf[q->tail % INTQ_BUFSIZE] = byte;
+  barrier ();                   /* Publish the byte, then the index. */
+  q->tail++;
+
+  /* Wake a consumer stalled on an empty queue. */
+  barrier ();
+  if (q->consumer_waiting)
+    {
+      q->consumer_waiting = false;
+      sema_up (&q->not_empty);
+    }
+
+  if (!in_intr)
+    lock_release (&q->producer_lock);
+}
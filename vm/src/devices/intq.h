@@ -0,0 +1,41 @@
+#ifndef DEVICES_INTQ_H
+#define DEVICES_INTQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+/* An "interrupt queue", a circular buffer carrying bytes in one
+   direction between a kernel thread and an external interrupt
+   handler.  See intq.c for the concurrency rules that let the
+   data path run without locks or interrupt disabling. */
+
+/* Queue buffer size, in bytes.  A power of 2, so that indices
+   wrap with a mask instead of a division. */
+#define INTQ_BUFSIZE 64
+
+struct intq
+  {
+    uint8_t buf[INTQ_BUFSIZE];  /* Buffer. */
+    unsigned head;              /* Dequeue position, owned by consumer. */
+    unsigned tail;              /* Enqueue position, owned by producer. */
+
+    /* Thread-side serialization and sleeping.  The interrupt
+       side never touches any of these locks or semaphores except
+       to post a wakeup token. */
+    struct lock consumer_lock;  /* Serializes thread-side consumers. */
+    struct lock producer_lock;  /* Serializes thread-side producers. */
+    bool consumer_waiting;      /* Consumer asleep waiting for a byte? */
+    bool producer_waiting;      /* Producer asleep waiting for room? */
+    struct semaphore not_empty; /* Wakeup tokens for the consumer. */
+    struct semaphore not_full;  /* Wakeup tokens for the producer. */
+  };
+
+void intq_init (struct intq *);
+bool intq_empty (const struct intq *);
+bool intq_full (const struct intq *);
+uint8_t intq_getc (struct intq *);
+size_t intq_read (struct intq *, uint8_t *, size_t);
+void intq_putc (struct intq *, uint8_t);
+
+#endif /* devices/intq.h */
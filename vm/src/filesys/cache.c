@@ -0,0 +1,367 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of sectors held in the cache.  64 sectors is 32 kB,
+   which is the limit suggested for a buffer cache in the Pintos
+   filesys project and comfortably covers our hot metadata. */
+#define CACHE_SIZE 64
+
+/* Interval between write-behind passes, in timer ticks. */
+#define WRITE_BEHIND_INTERVAL (TIMER_FREQ * 5)
+
+/* Capacity of the read-ahead request queue. */
+#define READ_AHEAD_QUEUE_SIZE 16
+
+/* A cached sector. */
+struct cache_entry
+  {
+    block_sector_t sector;              /* Sector number, if VALID. */
+    bool valid;                         /* Does this entry hold a sector? */
+    bool dirty;                         /* Modified since read from disk? */
+    bool accessed;                      /* Used by the clock hand. */
+    struct lock lock;                   /* Protects this entry's data. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+
+/* Protects sector-to-entry mapping and the clock hand.
+   Individual entry contents are protected by the entry lock, so
+   I/O to two different sectors can proceed in parallel. */
+static struct lock cache_map_lock;
+static int clock_hand;
+
+/* Read-ahead request queue, consumed by the read-ahead thread. */
+static block_sector_t read_ahead_queue[READ_AHEAD_QUEUE_SIZE];
+static int read_ahead_head, read_ahead_tail;
+static struct lock read_ahead_lock;
+static struct condition read_ahead_nonempty;
+
+static struct cache_entry *cache_get (block_sector_t, bool load);
+static struct cache_entry *cache_evict (void);
+static void cache_flush_entry (struct cache_entry *);
+static void write_behind_thread (void *aux UNUSED);
+static void read_ahead_thread (void *aux UNUSED);
+
+/* Initializes the buffer cache and spawns the write-behind and
+   read-ahead daemons.  Called from filesys_init() after the
+   block device is available. */
+void
+cache_init (void)
+{
+  int i;
+
+  lock_init (&cache_map_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      cache[i].valid = false;
+      lock_init (&cache[i].lock);
+    }
+  clock_hand = 0;
+
+  lock_init (&read_ahead_lock);
+  cond_init (&read_ahead_nonempty);
+  read_ahead_head = read_ahead_tail = 0;
+
+  thread_create ("cache-flush", PRI_DEFAULT, write_behind_thread, NULL);
+  thread_create ("read-ahead", PRI_DEFAULT, read_ahead_thread, NULL);
+}
+
+/* Writes every dirty cache entry back to disk.  Called from
+   filesys_done() and periodically by the write-behind thread.
+
+   The dirty entries are gathered up and submitted to the block
+   layer as one batch, which sorts them into a single ascending
+   sweep of the disk arm instead of writing them in cache-index
+   order.  Each gathered entry's lock is held until the batch
+   completes, so no writer can dirty an entry between its write
+   and the clearing of its dirty bit. */
+void
+cache_flush (void)
+{
+  struct block_request *reqs;
+  struct cache_entry **gathered;
+  size_t cnt, j;
+  int i;
+
+  reqs = malloc (CACHE_SIZE * sizeof *reqs);
+  gathered = malloc (CACHE_SIZE * sizeof *gathered);
+  if (reqs == NULL || gathered == NULL)
+    {
+      /* No memory for the batch: fall back to writing the dirty
+         entries one at a time. */
+      free (reqs);
+      free (gathered);
+      for (i = 0; i < CACHE_SIZE; i++)
+        {
+          struct cache_entry *ce = &cache[i];
+
+          lock_acquire (&ce->lock);
+          if (ce->valid && ce->dirty)
+            cache_flush_entry (ce);
+          lock_release (&ce->lock);
+        }
+      return;
+    }
+
+  cnt = 0;
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *ce = &cache[i];
+
+      lock_acquire (&ce->lock);
+      if (ce->valid && ce->dirty)
+        {
+          reqs[cnt].sector = ce->sector;
+          reqs[cnt].buffer = ce->data;
+          reqs[cnt].write = true;
+          gathered[cnt] = ce;
+          cnt++;
+        }
+      else
+        lock_release (&ce->lock);
+    }
+
+  if (cnt > 0)
+    block_submit (fs_device, reqs, cnt);
+
+  for (j = 0; j < cnt; j++)
+    {
+      gathered[j]->dirty = false;
+      lock_release (&gathered[j]->lock);
+    }
+  free (gathered);
+  free (reqs);
+}
+
+/* Reads SIZE bytes at OFFSET within SECTOR into BUFFER,
+   faulting the sector into the cache if necessary. */
+void
+cache_read (block_sector_t sector, void *buffer, off_t offset, off_t size)
+{
+  struct cache_entry *ce;
+
+  ASSERT (offset >= 0 && size >= 0);
+  ASSERT (offset + size <= BLOCK_SECTOR_SIZE);
+
+  ce = cache_get (sector, true);
+  memcpy (buffer, ce->data + offset, size);
+  ce->accessed = true;
+  lock_release (&ce->lock);
+}
+
+/* Writes SIZE bytes from BUFFER at OFFSET within SECTOR.  The
+   write goes to the cache only; it reaches disk on eviction or
+   the next write-behind pass.  A write that covers the whole
+   sector skips reading the old contents from disk. */
+void
+cache_write (block_sector_t sector, const void *buffer,
+             off_t offset, off_t size)
+{
+  struct cache_entry *ce;
+
+  ASSERT (offset >= 0 && size >= 0);
+  ASSERT (offset + size <= BLOCK_SECTOR_SIZE);
+
+  ce = cache_get (sector, offset != 0 || size != BLOCK_SECTOR_SIZE);
+  memcpy (ce->data + offset, buffer, size);
+  ce->accessed = true;
+  ce->dirty = true;
+  lock_release (&ce->lock);
+}
+
+/* Returns the cache entry holding SECTOR with its lock held, or
+   a null pointer if SECTOR is not cached.  Unlike cache_get(),
+   never evicts. */
+static struct cache_entry *
+cache_lookup (block_sector_t sector)
+{
+  int i;
+
+  lock_acquire (&cache_map_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].sector == sector)
+      {
+        struct cache_entry *ce = &cache[i];
+        lock_acquire (&ce->lock);
+        lock_release (&cache_map_lock);
+        return ce;
+      }
+  lock_release (&cache_map_lock);
+  return NULL;
+}
+
+/* Reads all of SECTOR into BUFFER, bypassing the cache on a
+   miss: the sector is read from disk directly into the caller's
+   buffer instead of being copied through a cache entry.  This is
+   the zero-copy fast path for whole-sector transfers; large
+   sequential reads neither pay an extra memcpy nor wipe out the
+   cached metadata working set.  A hit is still served from the
+   cache so dirty data is never stale. */
+void
+cache_read_direct (block_sector_t sector, void *buffer)
+{
+  struct cache_entry *ce = cache_lookup (sector);
+
+  if (ce != NULL)
+    {
+      memcpy (buffer, ce->data, BLOCK_SECTOR_SIZE);
+      ce->accessed = true;
+      lock_release (&ce->lock);
+    }
+  else
+    block_read (fs_device, sector, buffer);
+}
+
+/* Writes all of SECTOR from BUFFER.  If the sector is cached the
+   entry is updated in place; on a miss an entry is claimed and
+   filled (without reading the old contents from disk first).
+
+   Writing around the cache on a miss would be wrong, not just
+   slower: a concurrent reader claiming the sector after our
+   lookup missed would read the old contents from disk and leave
+   a stale clean entry shadowing this write for every future
+   read.  Zero-copy is only safe on the read side. */
+void
+cache_write_direct (block_sector_t sector, const void *buffer)
+{
+  struct cache_entry *ce = cache_lookup (sector);
+
+  if (ce == NULL)
+    ce = cache_get (sector, false);
+  memcpy (ce->data, buffer, BLOCK_SECTOR_SIZE);
+  ce->accessed = true;
+  ce->dirty = true;
+  lock_release (&ce->lock);
+}
+
+/* Queues SECTOR to be faulted into the cache in the background.
+   Used by inode_read_at() to prefetch the next sector of a
+   sequential read.  If the queue is full the request is simply
+   dropped: read-ahead is only a hint. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  lock_acquire (&read_ahead_lock);
+  if ((read_ahead_tail + 1) % READ_AHEAD_QUEUE_SIZE != read_ahead_head)
+    {
+      read_ahead_queue[read_ahead_tail] = sector;
+      read_ahead_tail = (read_ahead_tail + 1) % READ_AHEAD_QUEUE_SIZE;
+      cond_signal (&read_ahead_nonempty, &read_ahead_lock);
+    }
+  lock_release (&read_ahead_lock);
+}
+
+/* Returns the cache entry for SECTOR with its lock held,
+   evicting another entry if SECTOR is not already cached.  If
+   LOAD is true and the sector was not cached, its contents are
+   read from disk; otherwise the caller promises to overwrite the
+   whole entry. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool load)
+{
+  struct cache_entry *ce;
+  int i;
+
+  lock_acquire (&cache_map_lock);
+
+  /* Cache hit? */
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].sector == sector)
+      {
+        ce = &cache[i];
+        lock_acquire (&ce->lock);
+        lock_release (&cache_map_lock);
+        return ce;
+      }
+
+  /* Miss: claim an entry.  The entry lock is taken before the
+     map lock is released so no one else can claim it, but the
+     disk I/O below happens without the map lock held. */
+  ce = cache_evict ();
+  ce->sector = sector;
+  ce->valid = true;
+  ce->dirty = false;
+  ce->accessed = false;
+  lock_release (&cache_map_lock);
+
+  if (load)
+    block_read (fs_device, sector, ce->data);
+  else
+    memset (ce->data, 0, BLOCK_SECTOR_SIZE);
+  return ce;
+}
+
+/* Chooses an entry to reuse with the clock algorithm, writes it
+   back if dirty, and returns it with its lock held.  The map
+   lock must be held by the caller. */
+static struct cache_entry *
+cache_evict (void)
+{
+  for (;;)
+    {
+      struct cache_entry *ce = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (!lock_try_acquire (&ce->lock))
+        continue;
+      if (ce->valid && ce->accessed)
+        {
+          ce->accessed = false;
+          lock_release (&ce->lock);
+          continue;
+        }
+      if (ce->valid && ce->dirty)
+        cache_flush_entry (ce);
+      return ce;
+    }
+}
+
+/* Writes CE back to disk and clears its dirty bit.  CE's lock
+   must be held. */
+static void
+cache_flush_entry (struct cache_entry *ce)
+{
+  block_write (fs_device, ce->sector, ce->data);
+  ce->dirty = false;
+}
+
+/* Write-behind daemon: periodically flushes dirty sectors so a
+   crash loses at most a few seconds of data and evictions mostly
+   find clean entries. */
+static void
+write_behind_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (WRITE_BEHIND_INTERVAL);
+      cache_flush ();
+    }
+}
+
+/* Read-ahead daemon: faults queued sectors into the cache. */
+static void
+read_ahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+      struct cache_entry *ce;
+
+      lock_acquire (&read_ahead_lock);
+      while (read_ahead_head == read_ahead_tail)
+        cond_wait (&read_ahead_nonempty, &read_ahead_lock);
+      sector = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_QUEUE_SIZE;
+      lock_release (&read_ahead_lock);
+
+      ce = cache_get (sector, true);
+      lock_release (&ce->lock);
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+void cache_init (void);
+void cache_flush (void);
+void cache_read (block_sector_t, void *, off_t offset, off_t size);
+void cache_write (block_sector_t, const void *, off_t offset, off_t size);
+void cache_read_direct (block_sector_t, void *);
+void cache_write_direct (block_sector_t, const void *);
+void cache_read_ahead (block_sector_t);
+
+#endif /* filesys/cache.h */
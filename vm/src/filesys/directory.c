@@ -0,0 +1,479 @@
+#include "filesys/directory.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include <list.h>
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+
+/* A directory. */
+struct dir
+  {
+    struct inode *inode;                /* Backing store. */
+    off_t pos;                          /* Current position. */
+  };
+
+/* Entry states.  A zero-filled directory reads as all free
+   entries, and ENTRY_USED matches the old boolean in_use, so
+   linear directories written by earlier kernels read back
+   unchanged. */
+#define ENTRY_FREE 0                    /* Never used. */
+#define ENTRY_USED 1                    /* Holds a file. */
+#define ENTRY_TOMBSTONE 2               /* Deleted; probing continues. */
+
+/* A single directory entry. */
+struct dir_entry
+  {
+    block_sector_t inode_sector;        /* Sector number of header. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    uint8_t state;                      /* One of the ENTRY_* states. */
+  };
+
+/* Directories come in two on-disk formats.  A small directory is
+   a plain array of dir_entry records, scanned linearly.  Once it
+   outgrows LINEAR_MAX entries it is rewritten as an open-
+   addressed hash table: a dir_header followed by a power-of-two
+   array of dir_entry buckets, probed linearly from the name's
+   hash.  Deleted buckets become tombstones so probe chains stay
+   intact; rehashing on growth discards them.
+
+   The formats are distinguished by the header signature.  A
+   linear directory's first four bytes are an inode sector
+   number, which on any disk Pintos accepts (they are capped at
+   1 GB) is far below DIR_HASH_MAGIC. */
+#define DIR_HASH_MAGIC 0x48534944       /* "DISH", > any valid sector. */
+#define LINEAR_MAX 64                   /* Entries before converting. */
+
+/* Header of a hashed directory. */
+struct dir_header
+  {
+    uint32_t signature;                 /* DIR_HASH_MAGIC. */
+    uint32_t bucket_cnt;                /* Buckets in the table (power of 2). */
+    uint32_t filled_cnt;                /* Used + tombstone buckets. */
+  };
+
+static bool read_header (const struct dir *, struct dir_header *);
+static off_t bucket_ofs (const struct dir_header *, size_t bucket);
+static bool lookup (const struct dir *, const char *name,
+                    struct dir_entry *, off_t *);
+static bool convert_to_hashed (struct dir *, size_t bucket_cnt);
+static bool add_entry (struct dir *, const char *name, block_sector_t);
+
+/* Creates a directory with space for ENTRY_CNT entries in the
+   given SECTOR.  Returns true if successful, false on failure.
+   New directories start in the linear format regardless of
+   ENTRY_CNT; they convert themselves once they grow. */
+bool
+dir_create (block_sector_t sector, size_t entry_cnt)
+{
+  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+}
+
+/* Opens and returns the directory for the given INODE, of which
+   it takes ownership.  Returns a null pointer on failure. */
+struct dir *
+dir_open (struct inode *inode)
+{
+  struct dir *dir = calloc (1, sizeof *dir);
+  if (inode != NULL && dir != NULL)
+    {
+      dir->inode = inode;
+      dir->pos = 0;
+      return dir;
+    }
+  else
+    {
+      inode_close (inode);
+      free (dir);
+      return NULL;
+    }
+}
+
+/* Opens the root directory and returns a directory for it.
+   Return true if successful, false on failure. */
+struct dir *
+dir_open_root (void)
+{
+  return dir_open (inode_open (ROOT_DIR_SECTOR));
+}
+
+/* Opens and returns a new directory for the same inode as DIR.
+   Returns a null pointer on failure. */
+struct dir *
+dir_reopen (struct dir *dir)
+{
+  return dir_open (inode_reopen (dir->inode));
+}
+
+/* Destroys DIR and frees associated resources. */
+void
+dir_close (struct dir *dir)
+{
+  if (dir != NULL)
+    {
+      inode_close (dir->inode);
+      free (dir);
+    }
+}
+
+/* Returns the inode encapsulated by DIR. */
+struct inode *
+dir_get_inode (struct dir *dir)
+{
+  return dir->inode;
+}
+
+/* Reads DIR's header into *H and returns true if DIR is in the
+   hashed format, false if it is linear (in which case *H is not
+   meaningful). */
+static bool
+read_header (const struct dir *dir, struct dir_header *h)
+{
+  return (inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+          && h->signature == DIR_HASH_MAGIC);
+}
+
+/* Returns the byte offset of BUCKET within a hashed directory
+   described by H. */
+static off_t
+bucket_ofs (const struct dir_header *h, size_t bucket)
+{
+  ASSERT (bucket < h->bucket_cnt);
+  return sizeof *h + bucket * sizeof (struct dir_entry);
+}
+
+/* Searches DIR for a file with the given NAME.
+   If successful, returns true, sets *EP to the directory entry
+   if EP is non-null, and sets *OFSP to the byte offset of the
+   directory entry if OFSP is non-null.
+   Otherwise, returns false and ignores EP and OFSP.
+
+   A linear directory is scanned front to back; a hashed one is
+   probed from the name's hash bucket, so the expected cost is a
+   constant number of entry reads however large the directory. */
+static bool
+lookup (const struct dir *dir, const char *name,
+        struct dir_entry *ep, off_t *ofsp)
+{
+  struct dir_header h;
+  struct dir_entry e;
+  off_t ofs;
+
+  ASSERT (dir != NULL);
+  ASSERT (name != NULL);
+
+  if (read_header (dir, &h))
+    {
+      size_t bucket = hash_string (name) & (h.bucket_cnt - 1);
+      size_t i;
+
+      for (i = 0; i < h.bucket_cnt; i++)
+        {
+          ofs = bucket_ofs (&h, (bucket + i) & (h.bucket_cnt - 1));
+          if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e
+              || e.state == ENTRY_FREE)
+            break;
+          if (e.state == ENTRY_USED && !strcmp (name, e.name))
+            {
+              if (ep != NULL)
+                *ep = e;
+              if (ofsp != NULL)
+                *ofsp = ofs;
+              return true;
+            }
+        }
+      return false;
+    }
+
+  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.state == ENTRY_USED && !strcmp (name, e.name))
+      {
+        if (ep != NULL)
+          *ep = e;
+        if (ofsp != NULL)
+          *ofsp = ofs;
+        return true;
+      }
+  return false;
+}
+
+/* Searches DIR for a file with the given NAME
+   and returns true if one exists, false otherwise.
+   On success, sets *INODE to an inode for the file, otherwise to
+   a null pointer.  The caller must close *INODE. */
+bool
+dir_lookup (const struct dir *dir, const char *name,
+            struct inode **inode)
+{
+  struct dir_entry e;
+  bool found;
+
+  ASSERT (dir != NULL);
+  ASSERT (name != NULL);
+
+  inode_lock (dir->inode);
+  found = lookup (dir, name, &e, NULL);
+  inode_unlock (dir->inode);
+
+  *inode = found ? inode_open (e.inode_sector) : NULL;
+  return *inode != NULL;
+}
+
+/* Returns the number of ENTRY_USED entries in linear directory
+   DIR, which is also the number of entry slots a conversion must
+   carry over. */
+static size_t
+count_used (const struct dir *dir)
+{
+  struct dir_entry e;
+  size_t cnt = 0;
+  off_t ofs;
+
+  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.state == ENTRY_USED)
+      cnt++;
+  return cnt;
+}
+
+/* Inserts entry E into the in-memory hashed directory image
+   starting at IMAGE with the given header H.  There must be a
+   free bucket. */
+static void
+image_insert (const struct dir_header *h, uint8_t *image,
+              const struct dir_entry *e)
+{
+  size_t bucket = hash_string (e->name) & (h->bucket_cnt - 1);
+
+  for (;;)
+    {
+      struct dir_entry *slot = (struct dir_entry *)
+        (image + bucket_ofs (h, bucket));
+
+      if (slot->state == ENTRY_FREE)
+        {
+          *slot = *e;
+          return;
+        }
+      bucket = (bucket + 1) & (h->bucket_cnt - 1);
+    }
+}
+
+/* Rewrites DIR, in whichever format it is now, as a hashed
+   directory with BUCKET_CNT buckets (a power of two), dropping
+   tombstones.  Returns true on success, false if memory is
+   exhausted. */
+static bool
+convert_to_hashed (struct dir *dir, size_t bucket_cnt)
+{
+  struct dir_header old_h, h;
+  struct dir_entry e;
+  bool was_hashed = read_header (dir, &old_h);
+  off_t ofs = was_hashed ? (off_t) sizeof old_h : 0;
+  size_t size = sizeof h + bucket_cnt * sizeof e;
+  uint8_t *image;
+
+  ASSERT ((bucket_cnt & (bucket_cnt - 1)) == 0);
+
+  image = calloc (1, size);
+  if (image == NULL)
+    return false;
+
+  h.signature = DIR_HASH_MAGIC;
+  h.bucket_cnt = bucket_cnt;
+  h.filled_cnt = 0;
+  memcpy (image, &h, sizeof h);
+
+  for (; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.state == ENTRY_USED)
+      {
+        image_insert (&h, image, &e);
+        h.filled_cnt++;
+      }
+  memcpy (image, &h, sizeof h);
+
+  if (inode_write_at (dir->inode, image, size, 0) != (off_t) size)
+    {
+      free (image);
+      return false;
+    }
+  free (image);
+  return true;
+}
+
+/* Implementation of dir_add(); DIR's inode lock must be held. */
+static bool
+add_entry (struct dir *dir, const char *name, block_sector_t inode_sector)
+{
+  struct dir_header h;
+  struct dir_entry e;
+  off_t ofs;
+
+  ASSERT (dir != NULL);
+  ASSERT (name != NULL);
+
+  /* Check NAME for validity. */
+  if (*name == '\0' || strlen (name) > NAME_MAX)
+    return false;
+
+  /* Check that NAME is not in use. */
+  if (lookup (dir, name, NULL, NULL))
+    return false;
+
+  if (read_header (dir, &h))
+    {
+      size_t bucket;
+      size_t i;
+
+      /* Rehash at half full, so probe chains stay short.
+         Tombstones count: they lengthen chains just like used
+         buckets, and rehashing is how they are reclaimed. */
+      if (h.filled_cnt + 1 > h.bucket_cnt / 2)
+        {
+          if (!convert_to_hashed (dir, h.bucket_cnt * 2)
+              || !read_header (dir, &h))
+            return false;
+        }
+
+      bucket = hash_string (name) & (h.bucket_cnt - 1);
+      for (i = 0; i < h.bucket_cnt; i++)
+        {
+          ofs = bucket_ofs (&h, (bucket + i) & (h.bucket_cnt - 1));
+          if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+            return false;
+          if (e.state != ENTRY_USED)
+            {
+              if (e.state == ENTRY_FREE)
+                {
+                  h.filled_cnt++;
+                  if (inode_write_at (dir->inode, &h, sizeof h, 0)
+                      != sizeof h)
+                    return false;
+                }
+              e.state = ENTRY_USED;
+              strlcpy (e.name, name, sizeof e.name);
+              e.inode_sector = inode_sector;
+              return inode_write_at (dir->inode, &e, sizeof e, ofs)
+                == sizeof e;
+            }
+        }
+      return false;
+    }
+
+  /* Linear format: convert once the directory outgrows a cheap
+     scan, then insert hashed; otherwise take the first free
+     slot, extending the directory if every slot is taken.
+
+     inode_read_at() will only return a short read at end of
+     file.  Otherwise, we'd need to verify that we didn't get a
+     short read due to something intermittent such as low
+     memory. */
+  if (count_used (dir) >= LINEAR_MAX)
+    {
+      if (!convert_to_hashed (dir, 4 * LINEAR_MAX))
+        return false;
+      return add_entry (dir, name, inode_sector);
+    }
+
+  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.state != ENTRY_USED)
+      break;
+
+  e.state = ENTRY_USED;
+  strlcpy (e.name, name, sizeof e.name);
+  e.inode_sector = inode_sector;
+  return inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+}
+
+/* Adds a file named NAME to DIR, which must not already contain
+   a file by that name.  The file's inode is in sector
+   INODE_SECTOR.
+   Returns true if successful, false on failure.
+   Fails if NAME is invalid (i.e. too long) or a disk or memory
+   error occurs. */
+bool
+dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
+{
+  bool success;
+
+  inode_lock (dir->inode);
+  success = add_entry (dir, name, inode_sector);
+  inode_unlock (dir->inode);
+  return success;
+}
+
+/* Removes any entry for NAME in DIR.
+   Returns true if successful, false on failure,
+   which occurs only if there is no file with the given NAME. */
+bool
+dir_remove (struct dir *dir, const char *name)
+{
+  struct dir_header h;
+  struct dir_entry e;
+  struct inode *inode = NULL;
+  bool success = false;
+  off_t ofs;
+
+  ASSERT (dir != NULL);
+  ASSERT (name != NULL);
+
+  inode_lock (dir->inode);
+
+  /* Find directory entry. */
+  if (!lookup (dir, name, &e, &ofs))
+    goto done;
+
+  /* Open inode. */
+  inode = inode_open (e.inode_sector);
+  if (inode == NULL)
+    goto done;
+
+  /* Erase directory entry.  In the hashed format the slot
+     becomes a tombstone rather than free, so that probe chains
+     running through it stay connected. */
+  e.state = read_header (dir, &h) ? ENTRY_TOMBSTONE : ENTRY_FREE;
+  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+    goto done;
+
+  /* Remove inode. */
+  inode_remove (inode);
+  success = true;
+
+ done:
+  inode_unlock (dir->inode);
+  inode_close (inode);
+  return success;
+}
+
+/* Reads the next directory entry in DIR and stores the name in
+   NAME.  Returns true if successful, false if the directory
+   contains no more entries. */
+bool
+dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  struct dir_header h;
+  struct dir_entry e;
+  bool success = false;
+
+  inode_lock (dir->inode);
+  if (dir->pos == 0 && read_header (dir, &h))
+    dir->pos = sizeof h;
+
+  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e)
+    {
+      dir->pos += sizeof e;
+      if (e.state == ENTRY_USED)
+        {
+          strlcpy (name, e.name, NAME_MAX + 1);
+          success = true;
+          break;
+        }
+    }
+  inode_unlock (dir->inode);
+  return success;
+}
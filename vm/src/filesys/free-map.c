@@ -0,0 +1,215 @@
+#include "filesys/free-map.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+static struct file *free_map_file;   /* Free map file. */
+static struct bitmap *free_map;      /* Free map, one bit per sector. */
+
+/* The free map is divided into fixed-size allocation groups,
+   cylinder-group style.  Each group has its own lock and an
+   in-memory count of its free sectors, so an allocation can skip
+   a group that cannot possibly satisfy it without taking any
+   lock, and allocations in different groups do not contend at
+   all.  Callers with a locality preference (file extension) name
+   a sector to allocate near, and its group is searched first, so
+   a growing file's sectors cluster in one region of the disk.
+
+   The on-disk copy is still one bitmap, written back at close
+   (and at create), not on every allocation, both because a
+   sector of bookkeeping I/O per allocation would dwarf the
+   allocation itself and because writing the (sparse) free map
+   file can itself allocate sectors, which must be able to retake
+   the group locks. */
+
+/* Sectors per allocation group: 2 MB of disk.  A multiple of the
+   bitmap element size, so two groups never share a bitmap word
+   and each group's bits are touched only under its own lock. */
+#define FREE_MAP_GROUP_SIZE 4096
+
+/* An allocation group. */
+struct free_map_group
+  {
+    struct lock lock;           /* Guards this group's bits and count. */
+    block_sector_t start;       /* First sector in the group. */
+    size_t len;                 /* Number of sectors in the group. */
+    size_t free_cnt;            /* Free sectors, kept in memory. */
+  };
+
+static struct free_map_group *groups;
+static size_t group_cnt;
+
+/* Where the next no-preference allocation starts looking.
+   Advanced without synchronization: it is only a starting point,
+   so a lost update costs nothing. */
+static size_t group_rotor;
+
+/* Recomputes every group's free-sector count from the bitmap. */
+static void
+free_map_recount (void)
+{
+  size_t i;
+
+  for (i = 0; i < group_cnt; i++)
+    groups[i].free_cnt
+      = bitmap_count (free_map, groups[i].start, groups[i].len, false);
+}
+
+/* Initializes the free map. */
+void
+free_map_init (void)
+{
+  block_sector_t size = block_size (fs_device);
+  size_t i;
+
+  free_map = bitmap_create (size);
+  if (free_map == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+  bitmap_mark (free_map, FREE_MAP_SECTOR);
+  bitmap_mark (free_map, ROOT_DIR_SECTOR);
+
+  group_cnt = DIV_ROUND_UP (size, FREE_MAP_GROUP_SIZE);
+  groups = malloc (group_cnt * sizeof *groups);
+  if (groups == NULL)
+    PANIC ("couldn't allocate free map groups");
+  for (i = 0; i < group_cnt; i++)
+    {
+      struct free_map_group *g = &groups[i];
+
+      lock_init (&g->lock);
+      g->start = i * FREE_MAP_GROUP_SIZE;
+      g->len = size - g->start < FREE_MAP_GROUP_SIZE
+        ? size - g->start : FREE_MAP_GROUP_SIZE;
+    }
+  free_map_recount ();
+}
+
+/* Tries to allocate CNT consecutive sectors from group G,
+   storing the first into *SECTORP.  Returns true on success. */
+static bool
+group_allocate (struct free_map_group *g, size_t cnt, block_sector_t *sectorp)
+{
+  block_sector_t sector;
+
+  /* Unlocked peek at the summary; re-checked under the lock.
+     This is what lets an allocation pass over an exhausted group
+     without touching its lock or its bits. */
+  if (g->free_cnt < cnt)
+    return false;
+
+  lock_acquire (&g->lock);
+  if (g->free_cnt < cnt)
+    {
+      lock_release (&g->lock);
+      return false;
+    }
+  sector = bitmap_scan (free_map, g->start, cnt, false);
+  if (sector == BITMAP_ERROR || sector + cnt > g->start + g->len)
+    {
+      /* Enough free sectors, but no run of CNT inside this group.
+         (The scan runs off the end of the bitmap, so a hit past
+         our boundary belongs to some other group and is
+         discarded.) */
+      lock_release (&g->lock);
+      return false;
+    }
+  bitmap_set_multiple (free_map, sector, cnt, true);
+  g->free_cnt -= cnt;
+  lock_release (&g->lock);
+
+  *sectorp = sector;
+  return true;
+}
+
+/* Allocates CNT consecutive sectors and stores the first into
+   *SECTORP, trying the group containing NEAR first so that
+   related data lands in the same region of the disk.  Pass
+   (block_sector_t) -1 for no placement preference.  Returns true
+   if successful, false if no group had CNT consecutive free
+   sectors. */
+bool
+free_map_allocate_near (size_t cnt, block_sector_t *sectorp,
+                        block_sector_t near)
+{
+  size_t start, i;
+
+  ASSERT (cnt > 0);
+
+  start = near != (block_sector_t) -1
+    ? near / FREE_MAP_GROUP_SIZE
+    : group_rotor++ % group_cnt;
+  for (i = 0; i < group_cnt; i++)
+    if (group_allocate (&groups[(start + i) % group_cnt], cnt, sectorp))
+      return true;
+  return false;
+}
+
+/* Allocates CNT consecutive sectors with no placement preference
+   and stores the first into *SECTORP.
+   Returns true if successful, false if not enough consecutive
+   sectors were available. */
+bool
+free_map_allocate (size_t cnt, block_sector_t *sectorp)
+{
+  return free_map_allocate_near (cnt, sectorp, (block_sector_t) -1);
+}
+
+/* Makes CNT sectors starting at SECTOR available for use. */
+void
+free_map_release (block_sector_t sector, size_t cnt)
+{
+  struct free_map_group *g = &groups[sector / FREE_MAP_GROUP_SIZE];
+
+  /* Allocations never cross a group boundary, so releases
+     cannot either. */
+  ASSERT (sector + cnt <= g->start + g->len);
+
+  lock_acquire (&g->lock);
+  ASSERT (bitmap_all (free_map, sector, cnt));
+  bitmap_set_multiple (free_map, sector, cnt, false);
+  g->free_cnt += cnt;
+  lock_release (&g->lock);
+}
+
+/* Opens the free map file and reads it from disk. */
+void
+free_map_open (void)
+{
+  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (free_map_file == NULL)
+    PANIC ("can't open free map");
+  if (!bitmap_read (free_map, free_map_file))
+    PANIC ("can't read free map");
+  free_map_recount ();
+}
+
+/* Writes the free map to disk and closes the free map file. */
+void
+free_map_close (void)
+{
+  if (!bitmap_write (free_map, free_map_file))
+    PANIC ("can't write free map");
+  file_close (free_map_file);
+}
+
+/* Creates a new free map file on disk and writes the free map to
+   it. */
+void
+free_map_create (void)
+{
+  /* Create inode. */
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+    PANIC ("free map creation failed");
+
+  /* Write bitmap to file. */
+  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (free_map_file == NULL)
+    PANIC ("can't open free map");
+  if (!bitmap_write (free_map, free_map_file))
+    PANIC ("can't write free map");
+}
@@ -0,0 +1,608 @@
+#include "filesys/inode.h"
+#include <list.h>
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+
+/* Identifies an inode. */
+#define INODE_MAGIC 0x494e4f44
+
+/* Sector pointers in an indirect block. */
+#define PTRS_PER_SECTOR ((off_t) (BLOCK_SECTOR_SIZE / sizeof (block_sector_t)))
+
+/* Direct sector pointers in an on-disk inode.  Together with the
+   length, magic, and the two indirect pointers this fills the
+   sector exactly. */
+#define DIRECT_CNT 124
+
+/* File size limits of each level of the index. */
+#define DIRECT_BYTES (DIRECT_CNT * BLOCK_SECTOR_SIZE)
+#define INDIRECT_BYTES (PTRS_PER_SECTOR * BLOCK_SECTOR_SIZE)
+#define DBL_INDIRECT_BYTES (PTRS_PER_SECTOR * INDIRECT_BYTES)
+
+/* Marks an unallocated sector pointer.  A file may be sparse:
+   sectors that were never written read back as zeros. */
+#define SECTOR_NONE ((block_sector_t) -1)
+
+/* On-disk inode.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   Data sectors are found through a three-level index: DIRECT_CNT
+   direct pointers, one indirect block, and one doubly indirect
+   block, giving a maximum file size of a little over 8 MB.
+   Files grow lazily: writing past end-of-file allocates just the
+   sectors actually touched, one at a time, so growth needs no
+   up-front contiguous reservation. */
+struct inode_disk
+  {
+    off_t length;                       /* File size in bytes. */
+    unsigned magic;                     /* Magic number. */
+    block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+    block_sector_t indirect;            /* Indirect block. */
+    block_sector_t dbl_indirect;        /* Doubly indirect block. */
+  };
+
+/* Returns the number of sectors to allocate for an inode SIZE
+   bytes long. */
+static inline size_t
+bytes_to_sectors (off_t size)
+{
+  return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+}
+
+/* In-memory inode. */
+struct inode
+  {
+    struct list_elem elem;              /* Element in inode list. */
+    block_sector_t sector;              /* Sector number of disk location. */
+    int open_cnt;                       /* Number of openers. */
+    bool removed;                       /* True if deleted, false otherwise. */
+    int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct lock lock;                   /* Serializes writes and growth. */
+    struct inode_disk data;             /* Inode content. */
+  };
+
+/* List of open inodes, so that opening a single inode twice
+   returns the same `struct inode'. */
+static struct list open_inodes;
+
+/* Guards the open inode list and the open counts, so that
+   threads opening unrelated files do not contend on anything
+   wider. */
+static struct lock open_inodes_lock;
+
+/* Cache of struct inode records. */
+static struct slab *inode_slab;
+
+static void inode_release_sectors (struct inode_disk *);
+
+/* Allocates a zeroed data or index sector and stores its number
+   in *SECTORP, placing it in the same allocation group as NEAR
+   if possible (SECTOR_NONE for no preference).  Returns true on
+   success. */
+static bool
+allocate_zeroed_sector (block_sector_t *sectorp, block_sector_t near)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (!free_map_allocate_near (1, sectorp, near))
+    return false;
+  cache_write (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Reads sector pointer IDX of index block SECTOR.  If the slot
+   is empty and ALLOCATE is true, fills it with a fresh zeroed
+   sector first, allocated near the index block itself so a
+   file's data stays in its index's neighborhood.  Returns the
+   slot's value (possibly SECTOR_NONE). */
+static block_sector_t
+index_block_get (block_sector_t sector, off_t idx, bool allocate)
+{
+  block_sector_t entry;
+
+  cache_read (sector, &entry, idx * sizeof entry, sizeof entry);
+  if (entry == SECTOR_NONE && allocate)
+    {
+      if (!allocate_zeroed_sector (&entry, sector))
+        return SECTOR_NONE;
+      cache_write (sector, &entry, idx * sizeof entry, sizeof entry);
+    }
+  return entry;
+}
+
+/* Allocates an index block full of SECTOR_NONE pointers and
+   stores its number in *SECTORP, placed near sector NEAR
+   (SECTOR_NONE for no preference).  Returns true on success. */
+static bool
+allocate_index_block (block_sector_t *sectorp, block_sector_t near)
+{
+  block_sector_t empty[PTRS_PER_SECTOR];
+  off_t i;
+
+  if (!free_map_allocate_near (1, sectorp, near))
+    return false;
+  for (i = 0; i < PTRS_PER_SECTOR; i++)
+    empty[i] = SECTOR_NONE;
+  cache_write (*sectorp, empty, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Resolves data sector index SEC_IDX of DISK_INODE through the
+   index.  If ALLOCATE is true, missing data sectors and index
+   blocks along the way are allocated (and DISK_INODE is updated
+   in memory; the caller is responsible for writing it back).
+   Returns the data sector number, or SECTOR_NONE if the sector
+   is a hole (or allocation failed). */
+static block_sector_t
+index_to_sector (struct inode_disk *disk_inode, size_t sec_idx,
+                 bool allocate)
+{
+  /* Direct. */
+  if (sec_idx < DIRECT_CNT)
+    {
+      block_sector_t *slot = &disk_inode->direct[sec_idx];
+      if (*slot == SECTOR_NONE && allocate
+          && !allocate_zeroed_sector (slot,
+                                      sec_idx > 0
+                                      ? disk_inode->direct[sec_idx - 1]
+                                      : SECTOR_NONE))
+        return SECTOR_NONE;
+      return *slot;
+    }
+  sec_idx -= DIRECT_CNT;
+
+  /* Indirect. */
+  if (sec_idx < (size_t) PTRS_PER_SECTOR)
+    {
+      if (disk_inode->indirect == SECTOR_NONE)
+        {
+          if (!allocate
+              || !allocate_index_block (&disk_inode->indirect,
+                                        disk_inode->direct[DIRECT_CNT - 1]))
+            return SECTOR_NONE;
+        }
+      return index_block_get (disk_inode->indirect, sec_idx, allocate);
+    }
+  sec_idx -= PTRS_PER_SECTOR;
+
+  /* Doubly indirect. */
+  if (sec_idx < (size_t) (PTRS_PER_SECTOR * PTRS_PER_SECTOR))
+    {
+      block_sector_t indirect;
+
+      if (disk_inode->dbl_indirect == SECTOR_NONE)
+        {
+          if (!allocate
+              || !allocate_index_block (&disk_inode->dbl_indirect,
+                                        disk_inode->indirect))
+            return SECTOR_NONE;
+        }
+      indirect = index_block_get (disk_inode->dbl_indirect,
+                                  sec_idx / PTRS_PER_SECTOR, false);
+      if (indirect == SECTOR_NONE)
+        {
+          if (!allocate
+              || !allocate_index_block (&indirect,
+                                        disk_inode->dbl_indirect))
+            return SECTOR_NONE;
+          cache_write (disk_inode->dbl_indirect, &indirect,
+                       (sec_idx / PTRS_PER_SECTOR) * sizeof indirect,
+                       sizeof indirect);
+        }
+      return index_block_get (indirect, sec_idx % PTRS_PER_SECTOR, allocate);
+    }
+
+  /* Beyond the maximum file size. */
+  return SECTOR_NONE;
+}
+
+/* Returns the block device sector that contains byte offset POS
+   within INODE, or SECTOR_NONE if POS lies in a hole or past
+   end-of-file. */
+static block_sector_t
+byte_to_sector (const struct inode *inode, off_t pos)
+{
+  ASSERT (inode != NULL);
+  if (pos < inode->data.length)
+    return index_to_sector ((struct inode_disk *) &inode->data,
+                            pos / BLOCK_SECTOR_SIZE, false);
+  else
+    return SECTOR_NONE;
+}
+
+/* Initializes the inode module. */
+void
+inode_init (void)
+{
+  list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
+  inode_slab = slab_create ("inode", sizeof (struct inode));
+  if (inode_slab == NULL)
+    PANIC ("couldn't create inode slab");
+}
+
+/* Initializes an inode with LENGTH bytes of data and
+   writes the new inode to sector SECTOR on the file system
+   device.  No data sectors are allocated yet; they are filled in
+   lazily as the file is written, so creating even a very large
+   file is constant-time and cannot fail for lack of contiguous
+   space.
+   Returns true if successful.
+   Returns false if memory allocation fails. */
+bool
+inode_create (block_sector_t sector, off_t length)
+{
+  struct inode_disk *disk_inode = NULL;
+  size_t i;
+
+  ASSERT (length >= 0);
+
+  /* If this assertion fails, the inode structure is not exactly
+     one sector in size, and you should fix that. */
+  ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
+
+  if (length > DIRECT_BYTES + INDIRECT_BYTES + DBL_INDIRECT_BYTES)
+    return false;
+
+  disk_inode = calloc (1, sizeof *disk_inode);
+  if (disk_inode == NULL)
+    return false;
+
+  disk_inode->length = length;
+  disk_inode->magic = INODE_MAGIC;
+  for (i = 0; i < DIRECT_CNT; i++)
+    disk_inode->direct[i] = SECTOR_NONE;
+  disk_inode->indirect = SECTOR_NONE;
+  disk_inode->dbl_indirect = SECTOR_NONE;
+  cache_write (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+  free (disk_inode);
+  return true;
+}
+
+/* Reads an inode from SECTOR
+   and returns a `struct inode' that contains it.
+   Returns a null pointer if memory allocation fails. */
+struct inode *
+inode_open (block_sector_t sector)
+{
+  struct list_elem *e;
+  struct inode *inode;
+
+  /* Check whether this inode is already open. */
+  lock_acquire (&open_inodes_lock);
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+       e = list_next (e))
+    {
+      inode = list_entry (e, struct inode, elem);
+      if (inode->sector == sector)
+        {
+          inode->open_cnt++;
+          lock_release (&open_inodes_lock);
+          /* A first opener may still be reading the inode from
+             disk; it holds inode->lock until the data is in, so
+             waiting on it here keeps uninitialized data from
+             ever being seen. */
+          lock_acquire (&inode->lock);
+          lock_release (&inode->lock);
+          return inode;
+        }
+    }
+
+  /* Allocate memory. */
+  inode = slab_alloc (inode_slab);
+  if (inode == NULL)
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
+
+  /* Initialize.  The inode goes onto the list before its data is
+     read so that a concurrent open of the same sector finds this
+     copy instead of making another, but inode->lock is held
+     across the read: the lookup path above synchronizes on it,
+     so nobody uses the data before it is loaded.  Opens of other
+     inodes are not held up by the I/O. */
+  list_push_front (&open_inodes, &inode->elem);
+  inode->sector = sector;
+  inode->open_cnt = 1;
+  inode->deny_write_cnt = 0;
+  inode->removed = false;
+  lock_init (&inode->lock);
+  lock_acquire (&inode->lock);
+  lock_release (&open_inodes_lock);
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  lock_release (&inode->lock);
+  return inode;
+}
+
+/* Reopens and returns INODE. */
+struct inode *
+inode_reopen (struct inode *inode)
+{
+  if (inode != NULL)
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
+  return inode;
+}
+
+/* Returns INODE's inode number. */
+block_sector_t
+inode_get_inumber (const struct inode *inode)
+{
+  return inode->sector;
+}
+
+/* Releases every data and index sector reachable from
+   DISK_INODE. */
+static void
+inode_release_sectors (struct inode_disk *disk_inode)
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (disk_inode->direct[i] != SECTOR_NONE)
+      free_map_release (disk_inode->direct[i], 1);
+
+  if (disk_inode->indirect != SECTOR_NONE)
+    {
+      for (i = 0; i < (size_t) PTRS_PER_SECTOR; i++)
+        {
+          block_sector_t s = index_block_get (disk_inode->indirect, i, false);
+          if (s != SECTOR_NONE)
+            free_map_release (s, 1);
+        }
+      free_map_release (disk_inode->indirect, 1);
+    }
+
+  if (disk_inode->dbl_indirect != SECTOR_NONE)
+    {
+      for (i = 0; i < (size_t) PTRS_PER_SECTOR; i++)
+        {
+          block_sector_t ind
+            = index_block_get (disk_inode->dbl_indirect, i, false);
+          size_t j;
+
+          if (ind == SECTOR_NONE)
+            continue;
+          for (j = 0; j < (size_t) PTRS_PER_SECTOR; j++)
+            {
+              block_sector_t s = index_block_get (ind, j, false);
+              if (s != SECTOR_NONE)
+                free_map_release (s, 1);
+            }
+          free_map_release (ind, 1);
+        }
+      free_map_release (disk_inode->dbl_indirect, 1);
+    }
+}
+
+/* Closes INODE and writes it to disk.
+   If this was the last reference to INODE, frees its memory.
+   If INODE was also a removed inode, frees its blocks. */
+void
+inode_close (struct inode *inode)
+{
+  bool last;
+
+  /* Ignore null pointer. */
+  if (inode == NULL)
+    return;
+
+  /* Release resources if this was the last opener.  The list
+     lock covers only the reference count and unlinking; freeing
+     the inode's sectors can take its time outside it. */
+  lock_acquire (&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    list_remove (&inode->elem);
+  lock_release (&open_inodes_lock);
+
+  if (last)
+    {
+      /* Deallocate blocks if removed. */
+      if (inode->removed)
+        {
+          inode_release_sectors (&inode->data);
+          free_map_release (inode->sector, 1);
+        }
+
+      slab_free (inode_slab, inode);
+    }
+}
+
+/* Marks INODE to be deleted when it is closed by the last caller who
+   has it open. */
+void
+inode_remove (struct inode *inode)
+{
+  ASSERT (inode != NULL);
+  inode->removed = true;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached.
+   Holes (sectors never written) read back as zeros. */
+off_t
+inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
+{
+  uint8_t *buffer = buffer_;
+  off_t bytes_read = 0;
+
+  while (size > 0)
+    {
+      /* Disk sector to read, starting byte offset within sector. */
+      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+
+      /* Bytes left in inode, bytes left in sector, lesser of the two. */
+      off_t inode_left = inode_length (inode) - offset;
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int min_left = inode_left < sector_left ? inode_left : sector_left;
+
+      /* Number of bytes to actually copy out of this sector. */
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+
+      if (sector_idx == SECTOR_NONE)
+        /* Hole: reads as zeros. */
+        memset (buffer + bytes_read, 0, chunk_size);
+      else
+        {
+          block_sector_t next;
+
+          if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+            /* Whole-sector transfer: read disk-to-buffer directly
+               on a cache miss instead of staging through a cache
+               entry. */
+            cache_read_direct (sector_idx, buffer + bytes_read);
+          else
+            cache_read (sector_idx, buffer + bytes_read,
+                        sector_ofs, chunk_size);
+
+          /* Prefetch the next data sector of a sequential read.
+             Whole-sector reads prefetch too, even though they
+             bypass the cache themselves: the read-ahead entry
+             turns the next iteration's miss into a hit, and
+             sequential full-sector runs are the pattern
+             read-ahead exists for. */
+          next = byte_to_sector (inode, offset + chunk_size);
+          if (sector_ofs + chunk_size == BLOCK_SECTOR_SIZE
+              && next != SECTOR_NONE)
+            cache_read_ahead (next);
+        }
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
+
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if an error occurs.  A write past end-of-file
+   extends the inode, allocating only the sectors actually
+   touched; intervening sectors are left as holes. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+                off_t offset)
+{
+  const uint8_t *buffer = buffer_;
+  off_t bytes_written = 0;
+  bool locked;
+
+  if (inode->deny_write_cnt)
+    return 0;
+  if (offset + size > DIRECT_BYTES + INDIRECT_BYTES + DBL_INDIRECT_BYTES)
+    return 0;
+
+  /* One writer at a time per inode: concurrent writers race on
+     the in-memory index and length.  Readers of this inode, and
+     all traffic on other inodes, proceed in parallel; actual
+     sector transfers are protected by the per-entry cache
+     locks.  A caller that already holds the lock through
+     inode_lock() -- a directory updating its own entries -- is
+     covered by its own critical section. */
+  locked = !lock_held_by_current_thread (&inode->lock);
+  if (locked)
+    lock_acquire (&inode->lock);
+
+  while (size > 0)
+    {
+      /* Sector to write, starting byte offset within sector. */
+      block_sector_t sector_idx
+        = index_to_sector (&inode->data, offset / BLOCK_SECTOR_SIZE, true);
+      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+
+      /* Bytes left in sector. */
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+
+      /* Number of bytes to actually write into this sector. */
+      int chunk_size = size < sector_left ? size : sector_left;
+      if (chunk_size <= 0 || sector_idx == SECTOR_NONE)
+        break;
+
+      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+        cache_write_direct (sector_idx, buffer + bytes_written);
+      else
+        cache_write (sector_idx, buffer + bytes_written,
+                     sector_ofs, chunk_size);
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_written += chunk_size;
+    }
+
+  /* Extend the file if we wrote past the old end, and persist
+     any index updates made above. */
+  if (offset > inode->data.length)
+    inode->data.length = offset;
+  cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+
+  if (locked)
+    lock_release (&inode->lock);
+
+  return bytes_written;
+}
+
+/* Disables writes to INODE.
+   May be called at most once per inode opener. */
+void
+inode_deny_write (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+  inode->deny_write_cnt++;
+  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->lock);
+}
+
+/* Re-enables writes to INODE.
+   Must be called once by each inode opener who has called
+   inode_deny_write() on the inode, before closing the inode. */
+void
+inode_allow_write (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+  ASSERT (inode->deny_write_cnt > 0);
+  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  inode->deny_write_cnt--;
+  lock_release (&inode->lock);
+}
+
+/* Returns the length, in bytes, of INODE's data. */
+off_t
+inode_length (const struct inode *inode)
+{
+  return inode->data.length;
+}
+
+/* Acquires INODE's lock on behalf of a caller whose own data
+   structure INODE backs, e.g. a directory serializing its
+   operations. */
+void
+inode_lock (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+}
+
+/* Releases a lock taken with inode_lock(). */
+void
+inode_unlock (struct inode *inode)
+{
+  lock_release (&inode->lock);
+}
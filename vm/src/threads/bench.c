@@ -0,0 +1,246 @@
+#include "threads/bench.h"
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* In-kernel micro-benchmarks, so performance changes come with
+   numbers instead of vibes.  bench_run() times the hot paths the
+   kernel controls end to end -- context switches, timer wake-up
+   jitter, the allocators, and inode read bandwidth through the
+   buffer cache -- and prints one line per benchmark in cycles
+   and derived microseconds.  Run it via the kernel command line,
+   like the other one-shot actions, once the file system is up.
+
+   Paths that start in user mode (syscall round-trip, page-fault
+   service) can't be driven from here without a user process;
+   those are measured from the trace flight recorder instead, as
+   the deltas between their entry and completion records
+   (threads/trace.h). */
+
+/* Rounds of semaphore ping-pong; each is two context switches. */
+#define BENCH_PINGPONG_ROUNDS 10000
+
+/* timer_sleep(1) calls timed for wake-up jitter. */
+#define BENCH_SLEEP_ROUNDS 20
+
+/* malloc/free and palloc round-trips. */
+#define BENCH_MALLOC_ROUNDS 100000
+#define BENCH_MALLOC_SIZE 64
+#define BENCH_PALLOC_ROUNDS 10000
+
+/* Size of the scratch file for the inode bandwidth runs, and the
+   number of random single-sector reads. */
+#define BENCH_FILE_SIZE (512 * 512)
+#define BENCH_RANDOM_READS 512
+
+/* Cycles per timer tick, measured at bench_run() entry, so cycle
+   counts can be reported in wall-clock units. */
+static uint64_t cycles_per_tick;
+
+/* Reads the CPU's time-stamp counter. */
+static uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Measures cycles_per_tick by counting cycles across a run of
+   timer ticks, starting at a tick edge so partial ticks don't
+   skew the result. */
+static void
+calibrate (void)
+{
+  int64_t start_ticks;
+  uint64_t start_cycles;
+
+  start_ticks = timer_ticks ();
+  while (timer_ticks () == start_ticks)
+    continue;
+  start_ticks = timer_ticks ();
+  start_cycles = rdtsc ();
+  while (timer_ticks () < start_ticks + 10)
+    continue;
+  cycles_per_tick = (rdtsc () - start_cycles) / 10;
+}
+
+/* Prints one result line: CYCLES spent on ITERATIONS repetitions
+   of the operation NAME, per-operation, in cycles and derived
+   microseconds. */
+static void
+report (const char *name, uint64_t cycles, unsigned iterations)
+{
+  uint64_t per_op = cycles / iterations;
+  uint64_t ns = per_op * 1000000000 / (cycles_per_tick * TIMER_FREQ);
+
+  printf ("bench: %-24s %'8llu cycles  %llu.%03llu us\n",
+          name, (unsigned long long) per_op,
+          (unsigned long long) (ns / 1000), (unsigned long long) (ns % 1000));
+}
+
+/* Semaphore pair for the context-switch benchmark. */
+static struct semaphore bench_ping, bench_pong;
+
+/* Echo half of the ping-pong: answers each ping with a pong. */
+static void
+pong_thread (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < BENCH_PINGPONG_ROUNDS; i++)
+    {
+      sema_down (&bench_ping);
+      sema_up (&bench_pong);
+    }
+}
+
+/* Times a full scheduler round-trip: up a semaphore the partner
+   waits on, switch to the partner, and get switched back.  Each
+   round is two context switches plus two semaphore operations,
+   so the figure is the cost of handing the CPU over and back. */
+static void
+bench_context_switch (void)
+{
+  uint64_t start;
+  int i;
+
+  sema_init (&bench_ping, 0);
+  sema_init (&bench_pong, 0);
+  if (thread_create ("bench-pong", thread_get_priority (),
+                     pong_thread, NULL) == TID_ERROR)
+    {
+      printf ("bench: couldn't create partner thread, skipping\n");
+      return;
+    }
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_PINGPONG_ROUNDS; i++)
+    {
+      sema_up (&bench_ping);
+      sema_down (&bench_pong);
+    }
+  report ("switch round-trip", rdtsc () - start, BENCH_PINGPONG_ROUNDS);
+}
+
+/* Times timer_sleep(1) repeatedly and reports the average
+   oversleep past the one-tick minimum, plus the spread between
+   the best and worst wake-up -- the jitter a periodic thread
+   actually experiences. */
+static void
+bench_sleep_jitter (void)
+{
+  uint64_t total = 0, min = (uint64_t) -1, max = 0;
+  int i;
+
+  for (i = 0; i < BENCH_SLEEP_ROUNDS; i++)
+    {
+      uint64_t start = rdtsc ();
+      uint64_t elapsed;
+
+      timer_sleep (1);
+      elapsed = rdtsc () - start;
+      total += elapsed;
+      if (elapsed < min)
+        min = elapsed;
+      if (elapsed > max)
+        max = elapsed;
+    }
+  report ("sleep(1) wake-up", total, BENCH_SLEEP_ROUNDS);
+  report ("sleep(1) jitter", max - min, 1);
+}
+
+/* Times malloc/free pairs of a magazine-served size, and
+   palloc_get_page/palloc_free_page pairs. */
+static void
+bench_allocators (void)
+{
+  uint64_t start;
+  int i;
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_MALLOC_ROUNDS; i++)
+    free (malloc (BENCH_MALLOC_SIZE));
+  report ("malloc/free 64 B", rdtsc () - start, BENCH_MALLOC_ROUNDS);
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_PALLOC_ROUNDS; i++)
+    palloc_free_page (palloc_get_page (0));
+  report ("palloc get/free", rdtsc () - start, BENCH_PALLOC_ROUNDS);
+}
+
+/* Times sequential and random reads of a scratch file through
+   the buffer cache and inode index, reporting per-sector cost.
+   The file is created, written, read, and removed here; the
+   cache is warm for the reads, so this measures the in-memory
+   path, not the disk. */
+static void
+bench_inode_read (void)
+{
+  struct file *file;
+  uint8_t *buf;
+  uint64_t start;
+  off_t ofs;
+  int i;
+
+  buf = malloc (BLOCK_SECTOR_SIZE);
+  if (buf == NULL || !filesys_create ("bench0", BENCH_FILE_SIZE))
+    {
+      printf ("bench: couldn't create scratch file, skipping\n");
+      free (buf);
+      return;
+    }
+  file = filesys_open ("bench0");
+  if (file == NULL)
+    PANIC ("bench: couldn't open scratch file");
+
+  memset (buf, 0xb7, BLOCK_SECTOR_SIZE);
+  for (ofs = 0; ofs < BENCH_FILE_SIZE; ofs += BLOCK_SECTOR_SIZE)
+    if (file_write (file, buf, BLOCK_SECTOR_SIZE) != BLOCK_SECTOR_SIZE)
+      PANIC ("bench: short write to scratch file");
+
+  file_seek (file, 0);
+  start = rdtsc ();
+  for (ofs = 0; ofs < BENCH_FILE_SIZE; ofs += BLOCK_SECTOR_SIZE)
+    if (file_read (file, buf, BLOCK_SECTOR_SIZE) != BLOCK_SECTOR_SIZE)
+      PANIC ("bench: short read from scratch file");
+  report ("seq read/sector", rdtsc () - start,
+          BENCH_FILE_SIZE / BLOCK_SECTOR_SIZE);
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_RANDOM_READS; i++)
+    {
+      ofs = random_ulong () % (BENCH_FILE_SIZE / BLOCK_SECTOR_SIZE)
+        * BLOCK_SECTOR_SIZE;
+      file_read_at (file, buf, BLOCK_SECTOR_SIZE, ofs);
+    }
+  report ("rnd read/sector", rdtsc () - start, BENCH_RANDOM_READS);
+
+  file_close (file);
+  filesys_remove ("bench0");
+  free (buf);
+}
+
+/* Runs every benchmark and prints the results. */
+void
+bench_run (void)
+{
+  random_init (0);
+  calibrate ();
+  printf ("bench: %'llu cycles/tick, %d ticks/s\n",
+          (unsigned long long) cycles_per_tick, TIMER_FREQ);
+
+  bench_context_switch ();
+  bench_sleep_jitter ();
+  bench_allocators ();
+  bench_inode_read ();
+}
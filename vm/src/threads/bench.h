@@ -0,0 +1,9 @@
+#ifndef THREADS_BENCH_H
+#define THREADS_BENCH_H
+
+/* In-kernel micro-benchmarks.
+   See bench.c for commentary. */
+
+void bench_run (void);
+
+#endif /* threads/bench.h */
@@ -0,0 +1,59 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point arithmetic, used by the advanced
+   scheduler for its load average and recent-CPU estimates.  A
+   fixed_point_t is an int holding a real number scaled by
+   2**14. */
+
+typedef int fixed_point_t;
+
+/* Number of fractional bits and the corresponding scale. */
+#define FP_SHIFT 14
+#define FP_F (1 << FP_SHIFT)
+
+/* Converts integer N to fixed point. */
+static inline fixed_point_t
+fp_from_int (int n)
+{
+  return n * FP_F;
+}
+
+/* Converts X to an integer, truncating toward zero. */
+static inline int
+fp_to_int (fixed_point_t x)
+{
+  return x / FP_F;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fp_to_int_round (fixed_point_t x)
+{
+  return x >= 0 ? (x + FP_F / 2) / FP_F : (x - FP_F / 2) / FP_F;
+}
+
+/* Returns X + N, for integer N. */
+static inline fixed_point_t
+fp_add_int (fixed_point_t x, int n)
+{
+  return x + fp_from_int (n);
+}
+
+/* Returns X * Y. */
+static inline fixed_point_t
+fp_mul (fixed_point_t x, fixed_point_t y)
+{
+  return (int64_t) x * y / FP_F;
+}
+
+/* Returns X / Y. */
+static inline fixed_point_t
+fp_div (fixed_point_t x, fixed_point_t y)
+{
+  return (int64_t) x * FP_F / y;
+}
+
+#endif /* threads/fixed-point.h */
@@ -0,0 +1,411 @@
+#include "threads/malloc.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* A simple implementation of malloc().
+
+   The size of each request, in bytes, is rounded up to a power
+   of 2 and assigned to the "descriptor" that manages blocks of
+   that size.  The descriptor keeps a list of free blocks.  If
+   the free list is nonempty, one of its blocks is used.
+
+   Otherwise, a new page of memory, called an "arena", is
+   obtained from the page allocator (if none is available,
+   malloc() returns a null pointer).  The new arena is divided
+   into blocks, all of which are added to the descriptor's free
+   list.  Then we return one of the new blocks.
+
+   When we free a block, we add it to its descriptor's free list.
+   But if the arena that the block was in now has no in-use
+   blocks, we remove all of the arena's blocks from the free list
+   and give the arena back to the page allocator.
+
+   In front of the descriptors sits a per-thread "magazine": a
+   short freelist of blocks, one per size class, owned by each
+   thread.  Most malloc() calls pop from and most free() calls
+   push onto the running thread's magazine without taking any
+   lock; the descriptor lock is only touched when a magazine runs
+   empty (refilled with a batch of blocks) or overflows (half
+   drained back in a batch).  No synchronization is needed on the
+   magazines themselves because malloc() is not usable from
+   interrupt handlers anyway: it may sleep on a lock, so the only
+   code that touches a thread's magazine is the thread itself.
+
+   We can't handle blocks bigger than 2 kB using this scheme,
+   because they're too big to fit in a single page with a
+   descriptor.  We handle those by allocating contiguous pages
+   with the page allocator and sticking the allocation size at
+   the beginning of the allocated block's arena header. */
+
+/* Descriptor. */
+struct desc
+  {
+    size_t block_size;          /* Size of each element in bytes. */
+    size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    struct list free_list;      /* List of free blocks. */
+    struct lock lock;           /* Lock. */
+  };
+
+/* Magic number for detecting arena corruption. */
+#define ARENA_MAGIC 0x9a548eed
+
+/* Arena. */
+struct arena
+  {
+    unsigned magic;             /* Always set to ARENA_MAGIC. */
+    struct desc *desc;          /* Owning descriptor, null for big block. */
+    size_t free_cnt;            /* Free blocks; pages in big block. */
+  };
+
+/* Free block. */
+struct block
+  {
+    struct list_elem free_elem; /* Free list element. */
+  };
+
+/* Magazine tuning.  A refill moves MAG_REFILL blocks from the
+   descriptor per lock acquisition; a magazine that grows past
+   MAG_MAX blocks drains half.  Magazine blocks are chained
+   through their first word (every class is at least pointer
+   sized). */
+#define MAG_REFILL 8
+#define MAG_MAX 16
+
+/* Our set of descriptors. */
+static struct desc descs[10];   /* Descriptors. */
+static size_t desc_cnt;         /* Number of descriptors. */
+
+static struct arena *block_to_arena (struct block *);
+static struct block *arena_to_block (struct arena *, size_t idx);
+static struct block *alloc_block_locked (struct desc *);
+static void free_block_locked (struct desc *, struct block *);
+
+/* Initializes the malloc() descriptors. */
+void
+malloc_init (void)
+{
+  size_t block_size;
+
+  for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
+    {
+      struct desc *d = &descs[desc_cnt++];
+      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+      ASSERT (desc_cnt <= MALLOC_CLASS_CNT);
+      d->block_size = block_size;
+      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+      list_init (&d->free_list);
+      lock_init (&d->lock);
+    }
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size)
+{
+  struct thread *t = thread_current ();
+  struct desc *d;
+  struct block *b;
+  struct arena *a;
+  size_t class;
+  size_t i;
+
+  /* A null pointer satisfies a request for 0 bytes. */
+  if (size == 0)
+    return NULL;
+
+  /* Find the smallest descriptor that satisfies a SIZE-byte
+     request. */
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->block_size >= size)
+      break;
+  if (d == descs + desc_cnt)
+    {
+      /* SIZE is too big for any descriptor.
+         Allocate enough pages to hold SIZE plus an arena. */
+      size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+      a = palloc_get_multiple (0, page_cnt);
+      if (a == NULL)
+        return NULL;
+
+      /* Initialize the arena to indicate a big block of PAGE_CNT
+         pages, and return it. */
+      a->magic = ARENA_MAGIC;
+      a->desc = NULL;
+      a->free_cnt = page_cnt;
+      return a + 1;
+    }
+  class = d - descs;
+
+  /* Fast path: pop a block off this thread's magazine. */
+  b = t->magazines[class];
+  if (b != NULL)
+    {
+      t->magazines[class] = *(void **) b;
+      t->magazine_cnts[class]--;
+      return b;
+    }
+
+  /* Magazine empty: refill it with a batch from the descriptor
+     under one lock acquisition, and return the first block. */
+  lock_acquire (&d->lock);
+  b = alloc_block_locked (d);
+  for (i = 1; b != NULL && i < MAG_REFILL; i++)
+    {
+      struct block *extra = alloc_block_locked (d);
+      if (extra == NULL)
+        break;
+      *(void **) extra = t->magazines[class];
+      t->magazines[class] = extra;
+      t->magazine_cnts[class]++;
+    }
+  lock_release (&d->lock);
+  return b;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b)
+{
+  void *p;
+  size_t size;
+
+  /* Calculate block size and make sure it fits in size_t. */
+  size = a * b;
+  if (size < a || size < b)
+    return NULL;
+
+  /* Allocate and zero memory. */
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+
+  return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t
+block_size_of (void *block)
+{
+  struct block *b = block;
+  struct arena *a = block_to_arena (b);
+  struct desc *d = a->desc;
+
+  if (d != NULL)
+    return d->block_size;
+  else
+    {
+      /* This is a big block.  Subtract the amount of space used
+         by the arena header from the space allocated. */
+      return a->free_cnt * PGSIZE - pg_ofs (block);
+    }
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size)
+{
+  if (new_size == 0)
+    {
+      free (old_block);
+      return NULL;
+    }
+  else
+    {
+      void *new_block = malloc (new_size);
+      if (old_block != NULL && new_block != NULL)
+        {
+          size_t old_size = block_size_of (old_block);
+          size_t min_size = new_size < old_size ? new_size : old_size;
+          memcpy (new_block, old_block, min_size);
+          free (old_block);
+        }
+      return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p)
+{
+  if (p != NULL)
+    {
+      struct block *b = p;
+      struct arena *a = block_to_arena (b);
+      struct desc *d = a->desc;
+
+      if (d != NULL)
+        {
+          struct thread *t = thread_current ();
+          size_t class = d - descs;
+
+#ifndef NDEBUG
+          /* Clear the block to help detect use-after-free bugs,
+             leaving room for the magazine chain pointer. */
+          memset ((uint8_t *) b + sizeof (void *), 0xcc,
+                  d->block_size - sizeof (void *));
+#endif
+
+          /* Fast path: push onto this thread's magazine. */
+          *(void **) b = t->magazines[class];
+          t->magazines[class] = b;
+          if (++t->magazine_cnts[class] <= MAG_MAX)
+            return;
+
+          /* Magazine overflowed: drain half of it back to the
+             descriptor under one lock acquisition. */
+          lock_acquire (&d->lock);
+          while (t->magazine_cnts[class] > MAG_MAX / 2)
+            {
+              struct block *drained = t->magazines[class];
+              t->magazines[class] = *(void **) drained;
+              t->magazine_cnts[class]--;
+              free_block_locked (d, drained);
+            }
+          lock_release (&d->lock);
+        }
+      else
+        {
+          /* It's a big block.  Free its pages. */
+          palloc_free_multiple (a, a->free_cnt);
+        }
+    }
+}
+
+/* Returns every block cached in the current thread's magazines
+   to the shared descriptors.  Called as a thread exits, so that
+   its cached blocks are not stranded. */
+void
+malloc_thread_exit (void)
+{
+  struct thread *t = thread_current ();
+  size_t class;
+
+  for (class = 0; class < desc_cnt; class++)
+    if (t->magazines[class] != NULL)
+      {
+        struct desc *d = &descs[class];
+
+        lock_acquire (&d->lock);
+        while (t->magazines[class] != NULL)
+          {
+            struct block *b = t->magazines[class];
+            t->magazines[class] = *(void **) b;
+            free_block_locked (d, b);
+          }
+        lock_release (&d->lock);
+        t->magazine_cnts[class] = 0;
+      }
+}
+
+/* Takes a block from descriptor D's free list, creating a new
+   arena if the list is empty.  Returns a null pointer if no
+   memory is available.  D's lock must be held. */
+static struct block *
+alloc_block_locked (struct desc *d)
+{
+  struct block *b;
+  struct arena *a;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* If the free list is empty, create a new arena. */
+  if (list_empty (&d->free_list))
+    {
+      size_t i;
+
+      /* Allocate a page. */
+      a = palloc_get_page (0);
+      if (a == NULL)
+        return NULL;
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = 0; i < d->blocks_per_arena; i++)
+        {
+          struct block *block = arena_to_block (a, i);
+          list_push_back (&d->free_list, &block->free_elem);
+        }
+    }
+
+  /* Get a block from free list and return it. */
+  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+  a = block_to_arena (b);
+  a->free_cnt--;
+  return b;
+}
+
+/* Returns block B to descriptor D's free list, giving B's arena
+   back to the page allocator if it is now entirely unused.  D's
+   lock must be held. */
+static void
+free_block_locked (struct desc *d, struct block *b)
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* Add block to free list. */
+  list_push_front (&d->free_list, &b->free_elem);
+
+  /* If the arena is now entirely unused, free it. */
+  if (++a->free_cnt >= d->blocks_per_arena)
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++)
+        {
+          struct block *block = arena_to_block (a, i);
+          list_remove (&block->free_elem);
+        }
+      palloc_free_page (a);
+    }
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *
+block_to_arena (struct block *b)
+{
+  struct arena *a = pg_round_down (b);
+
+  /* Check that the arena is valid. */
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+
+  /* Check that the block is properly aligned for the arena. */
+  ASSERT (a->desc == NULL
+          || (pg_ofs (b) - sizeof *a) % a->desc->block_size == 0);
+  ASSERT (a->desc != NULL || pg_ofs (b) == sizeof *a);
+
+  return a;
+}
+
+/* Returns the (IDX - 1)'th block within arena A. */
+static struct block *
+arena_to_block (struct arena *a, size_t idx)
+{
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+  ASSERT (idx < a->desc->blocks_per_arena);
+  return (struct block *) ((uint8_t *) a
+                           + sizeof *a
+                           + idx * a->desc->block_size);
+}
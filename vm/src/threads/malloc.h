@@ -0,0 +1,19 @@
+#ifndef THREADS_MALLOC_H
+#define THREADS_MALLOC_H
+
+#include <debug.h>
+#include <stddef.h>
+
+/* Upper bound on the number of block size classes, for sizing
+   the per-thread magazines in struct thread.  The real count is
+   computed in malloc_init(). */
+#define MALLOC_CLASS_CNT 8
+
+void malloc_init (void);
+void *malloc (size_t) __attribute__ ((malloc));
+void *calloc (size_t, size_t) __attribute__ ((malloc));
+void *realloc (void *, size_t);
+void free (void *);
+void malloc_thread_exit (void);
+
+#endif /* threads/malloc.h */
@@ -0,0 +1,270 @@
+#include "threads/palloc.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/loader.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Page allocator.  Hands out memory in page-size (or
+   page-multiple) chunks.  See malloc.h for an allocator that
+   hands out smaller chunks.
+
+   System memory is divided into two "pools" called the kernel
+   and user pools.  The user pool is for user (virtual) memory
+   pages, the kernel pool for everything else.  The idea here is
+   that the kernel needs to have memory for its own operations
+   even if user processes are swapping like mad.
+
+   By default, half of system RAM is given to the kernel pool and
+   half to the user pool.  That should be huge overkill for the
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is split into POOL_SHARD_CNT "shards", each an
+   independently locked slice of the pool with its own free-page
+   bitmap.  An allocation takes only its shard's lock and scans
+   only that shard, so concurrent allocators on different shards
+   do not serialize and no single scan ever covers the whole
+   pool.  A rotor spreads successive allocations across shards,
+   and each shard remembers the lowest bit that might be free, so
+   the single-page case -- every page fault, via vm/frame.c --
+   normally flips the first bit it examines instead of scanning.
+   A multi-page run is satisfied entirely within one shard, which
+   bounds those scans at a shard's length. */
+
+/* Number of shards per pool.  A power of 2, so a page's shard is
+   a shift away; more shards mean less lock contention but
+   smaller maximum runs. */
+#define POOL_SHARD_CNT 8
+
+/* One shard of a pool. */
+struct pool_shard
+  {
+    struct lock lock;                   /* Mutual exclusion. */
+    struct bitmap *used_map;            /* Bitmap of this shard's pages. */
+    size_t page_cnt;                    /* Number of pages covered. */
+    size_t base_page;                   /* Index of first page in pool. */
+    size_t hint;                        /* No bit below this is free. */
+  };
+
+/* A memory pool. */
+struct pool
+  {
+    struct pool_shard shards[POOL_SHARD_CNT]; /* Sharded free maps. */
+    size_t rotor;                       /* Next shard to allocate from. */
+    uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Total pages in pool. */
+  };
+
+/* Two pools: one for kernel data, one for user pages. */
+static struct pool kernel_pool, user_pool;
+
+static void init_pool (struct pool *, void *base, size_t page_cnt,
+                       const char *name);
+static bool page_from_pool (const struct pool *, void *page);
+
+/* Initializes the page allocator.  At most USER_PAGE_LIMIT
+   pages are put into the user pool. */
+void
+palloc_init (size_t user_page_limit)
+{
+  /* Free memory starts at 1 MB and runs to the end of RAM. */
+  uint8_t *free_start = ptov (1024 * 1024);
+  uint8_t *free_end = ptov (init_ram_pages * PGSIZE);
+  size_t free_pages = (free_end - free_start) / PGSIZE;
+  size_t user_pages = free_pages / 2;
+  size_t kernel_pages;
+  if (user_pages > user_page_limit)
+    user_pages = user_page_limit;
+  kernel_pages = free_pages - user_pages;
+
+  /* Give half of memory to kernel, half to user. */
+  init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
+  init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
+             user_pages, "user pool");
+}
+
+/* Obtains and returns a group of PAGE_CNT contiguous free pages.
+   If PAL_USER is set, the pages are obtained from the user pool,
+   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   then the pages are filled with zeros.  If too few pages are
+   available, returns a null pointer, unless PAL_ASSERT is set in
+   FLAGS, in which case the kernel panics. */
+void *
+palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  void *pages = NULL;
+  size_t start, i;
+
+  if (page_cnt == 0)
+    return NULL;
+
+  /* Try each shard in turn, starting at the rotor's.  The rotor
+     advances without a lock: it is only a heuristic for
+     spreading allocators across shards, so a lost update is
+     harmless. */
+  start = pool->rotor++;
+  for (i = 0; i < POOL_SHARD_CNT && pages == NULL; i++)
+    {
+      struct pool_shard *s = &pool->shards[(start + i) % POOL_SHARD_CNT];
+      size_t page_idx;
+
+      if (s->page_cnt < page_cnt)
+        continue;
+
+      lock_acquire (&s->lock);
+
+      /* A single-page request starts scanning at the shard's
+         hint, below which no page is free, so it normally flips
+         the very first bit it looks at.  Longer runs must scan
+         from the beginning. */
+      page_idx = bitmap_scan_and_flip (s->used_map,
+                                       page_cnt == 1 ? s->hint : 0,
+                                       page_cnt, false);
+      if (page_idx != BITMAP_ERROR)
+        {
+          if (page_cnt == 1)
+            s->hint = page_idx + 1;
+          pages = pool->base + PGSIZE * (s->base_page + page_idx);
+        }
+      lock_release (&s->lock);
+    }
+
+  if (pages != NULL)
+    {
+      if (flags & PAL_ZERO)
+        memset (pages, 0, PGSIZE * page_cnt);
+    }
+  else
+    {
+      if (flags & PAL_ASSERT)
+        PANIC ("palloc_get: out of pages");
+    }
+
+  return pages;
+}
+
+/* Obtains a single free page and returns its kernel virtual
+   address.
+   If PAL_USER is set, the page is obtained from the user pool,
+   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   then the page is filled with zeros.  If no pages are
+   available, returns a null pointer, unless PAL_ASSERT is set in
+   FLAGS, in which case the kernel panics. */
+void *
+palloc_get_page (enum palloc_flags flags)
+{
+  return palloc_get_multiple (flags, 1);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGES. */
+void
+palloc_free_multiple (void *pages, size_t page_cnt)
+{
+  struct pool *pool;
+  struct pool_shard *s;
+  size_t page_idx;
+
+  ASSERT (pg_ofs (pages) == 0);
+  if (pages == NULL || page_cnt == 0)
+    return;
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    NOT_REACHED ();
+
+  /* Full-length shards come first, so dividing by the first
+     shard's length finds the owner. */
+  page_idx = pg_no (pages) - pg_no (pool->base);
+  s = &pool->shards[page_idx / pool->shards[0].page_cnt];
+  page_idx -= s->base_page;
+
+  /* Runs are allocated within a single shard. */
+  ASSERT (page_idx + page_cnt <= s->page_cnt);
+
+#ifndef NDEBUG
+  memset (pages, 0xcc, PGSIZE * page_cnt);
+#endif
+
+  lock_acquire (&s->lock);
+  ASSERT (bitmap_all (s->used_map, page_idx, page_cnt));
+  bitmap_set_multiple (s->used_map, page_idx, page_cnt, false);
+  if (page_idx < s->hint)
+    s->hint = page_idx;
+  lock_release (&s->lock);
+}
+
+/* Frees the page at PAGE. */
+void
+palloc_free_page (void *page)
+{
+  palloc_free_multiple (page, 1);
+}
+
+/* Initializes pool P as starting at START and ending at END,
+   naming it NAME for debugging purposes. */
+static void
+init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
+{
+  size_t shard_sz, bm_pages, i;
+  uint8_t *bm_buf;
+
+  /* Reserve pages at the head of the region for the shard
+     bitmaps. */
+  shard_sz = DIV_ROUND_UP (page_cnt, POOL_SHARD_CNT);
+  bm_pages = DIV_ROUND_UP (POOL_SHARD_CNT * bitmap_buf_size (shard_sz),
+                           PGSIZE);
+  if (bm_pages >= page_cnt)
+    PANIC ("Not enough memory in %s for bitmap.", name);
+  page_cnt -= bm_pages;
+  shard_sz = DIV_ROUND_UP (page_cnt, POOL_SHARD_CNT);
+
+  printf ("%zu pages available in %s.\n", page_cnt, name);
+
+  /* Initialize the pool. */
+  p->base = (uint8_t *) base + bm_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  p->rotor = 0;
+
+  /* Carve the pages into shards.  Every shard but the last
+     covers SHARD_SZ pages; trailing shards may be short or
+     empty when the pool is small. */
+  bm_buf = base;
+  for (i = 0; i < POOL_SHARD_CNT; i++)
+    {
+      struct pool_shard *s = &p->shards[i];
+      size_t base_page = i * shard_sz;
+      size_t cnt = base_page < page_cnt ? page_cnt - base_page : 0;
+      if (cnt > shard_sz)
+        cnt = shard_sz;
+
+      lock_init (&s->lock);
+      s->used_map = bitmap_create_in_buf (cnt, bm_buf,
+                                          bitmap_buf_size (cnt));
+      s->page_cnt = cnt;
+      s->base_page = base_page;
+      s->hint = 0;
+      bm_buf += bitmap_buf_size (cnt);
+    }
+}
+
+/* Returns true if PAGE was allocated from POOL,
+   false otherwise. */
+static bool
+page_from_pool (const struct pool *pool, void *page)
+{
+  size_t page_no = pg_no (page);
+  size_t start_page = pg_no (pool->base);
+  size_t end_page = start_page + pool->page_cnt;
+
+  return page_no >= start_page && page_no < end_page;
+}
@@ -0,0 +1,153 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Slab allocator for fixed-size kernel objects.
+
+   A slab serves exactly one object type.  Whole pages from the
+   page allocator are carved into as many objects as fit, with no
+   per-object header: the metadata all lives in the struct slab,
+   so no space is lost to bookkeeping and objects of the same
+   type pack densely, which keeps them warm in the hardware
+   caches.  Free objects are chained through their first word, so
+   slab_alloc() and slab_free() are single pointer pops and
+   pushes.
+
+   Freed objects are cached as-is rather than cleared
+   ("constructed-object caching"): whatever state the owner
+   reinitializes on every allocation anyway costs nothing here.
+
+   Pages are never given back to the page allocator.  A slab's
+   footprint is its peak population, which suits the long-lived
+   caches this is used for (threads, frame table entries,
+   supplemental page table entries, inodes).
+
+   The free list is guarded by disabling interrupts rather than
+   by a lock so that slab_free() is usable from contexts that
+   must not block, such as the scheduler tail that recycles a
+   dying thread's page. */
+
+/* A slab cache. */
+struct slab
+  {
+    char name[16];              /* For debugging purposes. */
+    size_t obj_size;            /* Object size in bytes. */
+    size_t objs_per_page;       /* Objects carved from each page. */
+    void *free_list;            /* Free objects, chained through word 0. */
+    size_t page_cnt;            /* Pages ever allocated, for statistics. */
+  };
+
+/* Creates and returns a slab cache named NAME, for debugging,
+   that serves objects of OBJ_SIZE bytes.  Returns a null pointer
+   if memory is not available. */
+struct slab *
+slab_create (const char *name, size_t obj_size)
+{
+  struct slab *s;
+
+  ASSERT (obj_size >= sizeof (void *));
+  ASSERT (obj_size <= PGSIZE);
+
+  s = malloc (sizeof *s);
+  if (s == NULL)
+    return NULL;
+  strlcpy (s->name, name, sizeof s->name);
+  s->obj_size = ROUND_UP (obj_size, sizeof (void *));
+  s->objs_per_page = PGSIZE / s->obj_size;
+  s->free_list = NULL;
+  s->page_cnt = 0;
+  return s;
+}
+
+/* Obtains an object from S, carving up a fresh page if the cache
+   is empty.  The object's contents are whatever its previous
+   user left there.  Returns a null pointer if memory is not
+   available. */
+void *
+slab_alloc (struct slab *s)
+{
+  enum intr_level old_level;
+  uint8_t *page;
+  void *obj;
+  size_t i;
+
+  old_level = intr_disable ();
+  obj = s->free_list;
+  if (obj != NULL)
+    s->free_list = *(void **) obj;
+  intr_set_level (old_level);
+  if (obj != NULL)
+    return obj;
+
+  /* Cache empty: carve up a new page.  The first object goes to
+     the caller and the rest onto the free list.  A slab whose
+     objects fill a whole page is just the degenerate one-object
+     case. */
+  page = palloc_get_page (0);
+  if (page == NULL)
+    return NULL;
+
+  old_level = intr_disable ();
+  for (i = 1; i < s->objs_per_page; i++)
+    {
+      void *extra = page + i * s->obj_size;
+      *(void **) extra = s->free_list;
+      s->free_list = extra;
+    }
+  s->page_cnt++;
+  intr_set_level (old_level);
+  return page;
+}
+
+/* Preloads S's cache with at least CNT objects, so that the next
+   CNT allocations are guaranteed to be pointer pops that never
+   touch the page allocator.  Rounds up to whole pages.  Panics
+   if memory is not available: reserving is done at boot, where
+   running short is fatal anyway. */
+void
+slab_reserve (struct slab *s, size_t cnt)
+{
+  while (cnt > 0)
+    {
+      enum intr_level old_level;
+      uint8_t *page;
+      size_t i;
+
+      page = palloc_get_page (0);
+      if (page == NULL)
+        PANIC ("slab %s: couldn't reserve %zu objects", s->name, cnt);
+
+      old_level = intr_disable ();
+      for (i = 0; i < s->objs_per_page; i++)
+        {
+          void *obj = page + i * s->obj_size;
+          *(void **) obj = s->free_list;
+          s->free_list = obj;
+        }
+      s->page_cnt++;
+      intr_set_level (old_level);
+
+      cnt -= cnt > s->objs_per_page ? s->objs_per_page : cnt;
+    }
+}
+
+/* Returns OBJ, which must have been obtained from S, to S's
+   cache.  Safe to call with interrupts off. */
+void
+slab_free (struct slab *s, void *obj)
+{
+  enum intr_level old_level;
+
+  ASSERT (obj != NULL);
+
+  old_level = intr_disable ();
+  *(void **) obj = s->free_list;
+  s->free_list = obj;
+  intr_set_level (old_level);
+}
@@ -0,0 +1,14 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Slab allocator for fixed-size kernel objects.
+   See slab.c for commentary. */
+
+struct slab *slab_create (const char *name, size_t obj_size);
+void *slab_alloc (struct slab *);
+void slab_reserve (struct slab *, size_t cnt);
+void slab_free (struct slab *, void *);
+
+#endif /* threads/slab.h */
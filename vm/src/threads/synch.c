@@ -0,0 +1,504 @@
+/* This file is derived from source code for the Nachos
+   instructional operating system.  The Nachos copyright notice
+   is reproduced in full below. */
+
+/* Copyright (c) 1992-1996 The Regents of the University of California.
+   All rights reserved.
+
+   Permission to use, copy, modify, and distribute this software
+   and its documentation for any purpose, without fee, and
+   without written agreement is hereby granted, provided that the
+   above copyright notice and the following two paragraphs appear
+   in all copies of this software.
+
+   IN NO EVENT SHALL THE UNIVERSITY OF CALIFORNIA BE LIABLE TO
+   ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR
+   CONSEQUENTIAL DAMAGES ARISING OUT OF THE USE OF THIS SOFTWARE
+   AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF CALIFORNIA
+   HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+   THE UNIVERSITY OF CALIFORNIA SPECIFICALLY DISCLAIMS ANY
+   WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+   PURPOSE.  THE SOFTWARE PROVIDED HEREUNDER IS ON AN "AS IS"
+   BASIS, AND THE UNIVERSITY OF CALIFORNIA HAS NO OBLIGATION TO
+   PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR
+   MODIFICATIONS.
+*/
+
+#include "threads/synch.h"
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Maximum length of a donation chain.  Donation propagates from
+   a lock's waiter to its holder, from there to whatever lock the
+   holder is itself waiting on, and so forth; chains deeper than
+   this are cut off rather than walked forever. */
+#define DONATION_DEPTH_MAX 8
+
+/* Iterations of the adaptive spin in lock_acquire() before
+   giving up and blocking. */
+#define LOCK_SPIN_MAX 128
+
+/* Initializes semaphore SEMA to VALUE.  A semaphore is a
+   nonnegative integer along with two atomic operators for
+   manipulating it:
+
+   - down or "P": wait for the value to become positive, then
+     decrement it.
+
+   - up or "V": increment the value (and wake up one waiting
+     thread, if any). */
+void
+sema_init (struct semaphore *sema, unsigned value)
+{
+  ASSERT (sema != NULL);
+
+  sema->value = value;
+  list_init (&sema->waiters);
+}
+
+/* Down or "P" operation on a semaphore.  Waits for SEMA's value
+   to become positive and then atomically decrements it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler.  This function may be called with
+   interrupts disabled, but if it sleeps then the next scheduled
+   thread will probably turn interrupts back on. */
+void
+sema_down (struct semaphore *sema)
+{
+  enum intr_level old_level;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  while (sema->value == 0)
+    {
+      list_push_back (&sema->waiters, &thread_current ()->elem);
+      thread_block ();
+    }
+  sema->value--;
+  intr_set_level (old_level);
+}
+
+/* Down or "P" operation on a semaphore, but only if the
+   semaphore is not already 0.  Returns true if the semaphore is
+   decremented, false otherwise.
+
+   This function may be called from an interrupt handler. */
+bool
+sema_try_down (struct semaphore *sema)
+{
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (sema != NULL);
+
+  old_level = intr_disable ();
+  if (sema->value > 0)
+    {
+      sema->value--;
+      success = true;
+    }
+  else
+    success = false;
+  intr_set_level (old_level);
+
+  return success;
+}
+
+/* Returns true if waiter A has lower priority than waiter B.
+   For list_max() over a semaphore's waiter list. */
+static bool
+sema_waiter_less (const struct list_elem *a_, const struct list_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority < b->priority;
+}
+
+/* Up or "V" operation on a semaphore.  Increments SEMA's value
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, yielding to it if it outranks the running
+   thread.
+
+   The waiter list is scanned at wakeup rather than kept sorted
+   because priority donation can reprioritize a blocked waiter in
+   place; waiter lists are short, unlike the ready queues, whose
+   per-priority lists and bitmap would fatten every embedded
+   semaphore.
+
+   This function may be called from an interrupt handler. */
+void
+sema_up (struct semaphore *sema)
+{
+  enum intr_level old_level;
+  struct thread *woken = NULL;
+
+  ASSERT (sema != NULL);
+
+  old_level = intr_disable ();
+  if (!list_empty (&sema->waiters))
+    {
+      struct list_elem *max = list_max (&sema->waiters,
+                                        sema_waiter_less, NULL);
+
+      list_remove (max);
+      woken = list_entry (max, struct thread, elem);
+      thread_unblock (woken);
+    }
+  sema->value++;
+
+  if (woken != NULL && woken->priority > thread_current ()->priority)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield ();
+    }
+  intr_set_level (old_level);
+}
+
+static void sema_test_helper (void *sema_);
+
+/* Self-test for semaphores that makes control "ping-pong"
+   between a pair of threads.  Insert calls to printf() to see
+   what's going on. */
+void
+sema_self_test (void)
+{
+  struct semaphore sema[2];
+  int i;
+
+  printf ("Testing semaphores...");
+  sema_init (&sema[0], 0);
+  sema_init (&sema[1], 0);
+  thread_create ("sema-test", PRI_DEFAULT, sema_test_helper, &sema);
+  for (i = 0; i < 10; i++)
+    {
+      sema_up (&sema[0]);
+      sema_down (&sema[1]);
+    }
+  printf ("done.\n");
+}
+
+/* Thread function used by sema_self_test(). */
+static void
+sema_test_helper (void *sema_)
+{
+  struct semaphore *sema = sema_;
+  int i;
+
+  for (i = 0; i < 10; i++)
+    {
+      sema_down (&sema[0]);
+      sema_up (&sema[1]);
+    }
+}
+
+/* Initializes LOCK.  A lock can be held by at most a single
+   thread at any given time.  Our locks are not "recursive", that
+   is, it is an error for the thread currently holding a lock to
+   try to acquire that lock.
+
+   A lock is a specialization of a semaphore with an initial
+   value of 1.  The difference between a lock and such a
+   semaphore is twofold.  First, a semaphore can have a value
+   greater than 1, but a lock can only be owned by a single
+   thread at a time.  Second, a semaphore does not have an owner,
+   meaning that one thread can "down" the semaphore and then
+   another one "up" it, but with a lock the same thread must both
+   acquire and release it.  When these restrictions prove
+   onerous, it's a good sign that a semaphore should be used,
+   instead of a lock. */
+void
+lock_init (struct lock *lock)
+{
+  ASSERT (lock != NULL);
+
+  lock->holder = NULL;
+  sema_init (&lock->semaphore, 1);
+}
+
+/* Acquires LOCK, sleeping until it becomes available if
+   necessary.  The lock must not already be held by the current
+   thread.
+
+   Before blocking, the current thread donates its priority to
+   the lock's holder, and transitively to whatever that holder is
+   itself waiting on, so that a low-priority holder cannot be
+   starved by middling-priority threads while we wait.  The
+   donation is revoked in lock_release().
+
+   If instead the holder is running on another CPU, it will
+   probably release the lock long before a sleep-and-reschedule
+   round trip completes, so we first spin briefly.  With CPU_CNT
+   equal to 1 a holder can never be running while we are, so the
+   spin falls through immediately.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler.  This function may be called with
+   interrupts disabled, but interrupts will be turned back on if
+   we need to sleep. */
+void
+lock_acquire (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int spin;
+
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  /* Adaptive spin. */
+  for (spin = 0; spin < LOCK_SPIN_MAX; spin++)
+    {
+      struct thread *holder = lock->holder;
+
+      if (holder == NULL)
+        {
+          if (lock_try_acquire (lock))
+            return;
+        }
+      else if (holder->status != THREAD_RUNNING)
+        break;
+      asm volatile ("pause" : : : "memory");
+    }
+
+  old_level = intr_disable ();
+  if (!sema_try_down (&lock->semaphore))
+    {
+      /* Donate our priority down the chain of holders.  The
+         advanced scheduler controls priorities itself, so
+         donation is disabled under it. */
+      struct lock *l = lock;
+      int depth;
+
+      cur->waiting_lock = lock;
+      for (depth = 0; !thread_mlfqs && depth < DONATION_DEPTH_MAX; depth++)
+        {
+          struct thread *holder = l->holder;
+
+          if (holder == NULL || holder->priority >= cur->priority)
+            break;
+          thread_update_priority (holder, cur->priority);
+          l = holder->waiting_lock;
+          if (l == NULL)
+            break;
+        }
+
+      sema_down (&lock->semaphore);
+      cur->waiting_lock = NULL;
+    }
+  lock->holder = cur;
+  list_push_back (&cur->locks_held, &lock->elem);
+  intr_set_level (old_level);
+}
+
+/* Tries to acquires LOCK and returns true if successful or false
+   on failure.  The lock must not already be held by the current
+   thread.
+
+   This function will not sleep, so it may be called within an
+   interrupt handler. */
+bool
+lock_try_acquire (struct lock *lock)
+{
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (lock != NULL);
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  old_level = intr_disable ();
+  success = sema_try_down (&lock->semaphore);
+  if (success)
+    {
+      lock->holder = thread_current ();
+      list_push_back (&thread_current ()->locks_held, &lock->elem);
+    }
+  intr_set_level (old_level);
+  return success;
+}
+
+/* Releases LOCK, which must be owned by the current thread,
+   and gives back any priority that the lock's waiters donated.
+   If shedding the donation lowered our priority, yields so a
+   higher-priority thread (likely the waiter we just woke) can
+   run.
+
+   An interrupt handler cannot acquire a lock, so it does not
+   make sense to try to release a lock within an interrupt
+   handler. */
+void
+lock_release (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool lowered;
+  int priority;
+
+  ASSERT (lock != NULL);
+  ASSERT (lock_held_by_current_thread (lock));
+
+  old_level = intr_disable ();
+  list_remove (&lock->elem);
+  lock->holder = NULL;
+
+  /* Give back any donated priority; under the advanced scheduler
+     there are no donations to shed. */
+  lowered = false;
+  if (!thread_mlfqs)
+    {
+      priority = thread_compute_priority (cur);
+      lowered = priority < cur->priority;
+      thread_update_priority (cur, priority);
+    }
+
+  sema_up (&lock->semaphore);
+  intr_set_level (old_level);
+
+  if (lowered)
+    thread_yield ();
+}
+
+/* Returns true if the current thread holds LOCK, false
+   otherwise.  (Note that testing whether some other thread holds
+   a lock would be racy.) */
+bool
+lock_held_by_current_thread (const struct lock *lock)
+{
+  ASSERT (lock != NULL);
+
+  return lock->holder == thread_current ();
+}
+
+/* One semaphore in a list. */
+struct semaphore_elem
+  {
+    struct list_elem elem;              /* List element. */
+    struct semaphore semaphore;         /* This semaphore. */
+  };
+
+/* Initializes condition variable COND.  A condition variable
+   allows one piece of code to signal a condition and cooperating
+   code to receive the signal and act upon it. */
+void
+cond_init (struct condition *cond)
+{
+  ASSERT (cond != NULL);
+
+  list_init (&cond->waiters);
+}
+
+/* Atomically releases LOCK and waits for COND to be signaled by
+   some other piece of code.  After COND is signaled, LOCK is
+   reacquired before returning.  LOCK must be held before calling
+   this function.
+
+   The monitor implemented by this function is "Mesa" style, not
+   "Hoare" style, that is, sending and receiving a signal are not
+   an atomic operation.  Thus, typically the caller must recheck
+   the condition after the wait completes and, if necessary, wait
+   again.
+
+   A given condition variable is associated with only a single
+   lock, but one lock may be associated with any number of
+   condition variables.  That is, there is a one-to-many mapping
+   from locks to condition variables.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler.  This function may be called with
+   interrupts disabled, but interrupts will be turned back on if
+   we need to sleep. */
+void
+cond_wait (struct condition *cond, struct lock *lock)
+{
+  struct semaphore_elem waiter;
+
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+
+  sema_init (&waiter.semaphore, 0);
+  list_push_back (&cond->waiters, &waiter.elem);
+  lock_release (lock);
+  sema_down (&waiter.semaphore);
+  lock_acquire (lock);
+}
+
+/* Returns true if the thread waiting on A has lower priority
+   than the one waiting on B.  A waiter that has queued itself
+   but not yet blocked on its semaphore ranks lowest; waking it
+   merely costs it the block.  For list_max() over a condition
+   variable's waiter list. */
+static bool
+cond_waiter_less (const struct list_elem *a_, const struct list_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct semaphore_elem *a = list_entry (a_, struct semaphore_elem,
+                                               elem);
+  const struct semaphore_elem *b = list_entry (b_, struct semaphore_elem,
+                                               elem);
+  int a_priority = PRI_MIN - 1, b_priority = PRI_MIN - 1;
+
+  if (!list_empty (&a->semaphore.waiters))
+    a_priority = list_entry (list_front (&a->semaphore.waiters),
+                             struct thread, elem)->priority;
+  if (!list_empty (&b->semaphore.waiters))
+    b_priority = list_entry (list_front (&b->semaphore.waiters),
+                             struct thread, elem)->priority;
+  return a_priority < b_priority;
+}
+
+/* If any threads are waiting on COND (protected by LOCK), then
+   this function signals the highest-priority one of them to wake
+   up from its wait.  LOCK must be held before calling this
+   function.
+
+   An interrupt handler cannot acquire a lock, so it does not
+   make sense to try to signal a condition variable within an
+   interrupt handler. */
+void
+cond_signal (struct condition *cond, struct lock *lock UNUSED)
+{
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+
+  if (!list_empty (&cond->waiters))
+    {
+      enum intr_level old_level = intr_disable ();
+      struct list_elem *max = list_max (&cond->waiters,
+                                        cond_waiter_less, NULL);
+
+      list_remove (max);
+      intr_set_level (old_level);
+      sema_up (&list_entry (max, struct semaphore_elem, elem)->semaphore);
+    }
+}
+
+/* Wakes up all threads, if any, waiting on COND (protected by
+   LOCK).  LOCK must be held before calling this function.
+
+   An interrupt handler cannot acquire a lock, so it does not
+   make sense to try to signal a condition variable within an
+   interrupt handler. */
+void
+cond_broadcast (struct condition *cond, struct lock *lock)
+{
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+
+  while (!list_empty (&cond->waiters))
+    cond_signal (cond, lock);
+}
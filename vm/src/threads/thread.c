@@ -0,0 +1,978 @@
+#include "threads/thread.h"
+#include <debug.h>
+#include <stddef.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
+#include "threads/flags.h"
+#include "threads/interrupt.h"
+#include "threads/intr-stubs.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/switch.h"
+#include "threads/synch.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/process.h"
+#endif
+
+/* Random value for struct thread's `magic' member.
+   Used to detect stack overflow.  See the big comment at the top
+   of thread.h for details. */
+#define THREAD_MAGIC 0xcd6abf4b
+
+/* Number of CPUs the scheduler is built for.  The boot path and
+   interrupt layer only bring up one CPU, so this stays 1 for
+   now, but nothing below hardwires it: each CPU owns one
+   `struct ready_queue' and idles on its own idle thread, and
+   ready_queue_steal() rebalances between queues. */
+#define CPU_CNT 1
+
+/* A per-CPU run queue.
+
+   One list per priority level plus a bitmap with bit P set
+   exactly when lists[P] is nonempty.  Finding the highest ready
+   priority is a single count-leading-zeros on the bitmap, so
+   enqueueing and dequeueing are both O(1) regardless of how many
+   threads are ready.  (PRI_MAX is 63, so one 64-bit word covers
+   every priority level.)
+
+   On a uniprocessor, disabling interrupts is sufficient mutual
+   exclusion for queue access; once CPU_CNT grows past 1 every
+   access below must additionally take a per-queue spinlock,
+   which the interrupt layer does not yet provide. */
+struct ready_queue
+  {
+    struct list lists[PRI_MAX + 1];     /* Per-priority FIFO lists. */
+    uint64_t bitmap;                    /* Occupancy bitmap. */
+    struct thread *idle_thread;         /* This CPU's idle thread. */
+  };
+
+static struct ready_queue ready_queues[CPU_CNT];
+
+/* Returns the ID of the CPU we are running on.  There is only
+   one until the boot path learns to start application
+   processors. */
+static inline size_t
+cpu_id (void)
+{
+  return 0;
+}
+
+/* Returns the run queue of the current CPU. */
+static inline struct ready_queue *
+ready_queue_current (void)
+{
+  return &ready_queues[cpu_id ()];
+}
+
+/* List of all processes.  Processes are added to this list
+   when they are first scheduled and removed when they exit. */
+static struct list all_list;
+
+/* Initial thread, the thread running init.c:main(). */
+static struct thread *initial_thread;
+
+/* Cache of thread pages, so exited threads' pages are recycled
+   directly into new threads.  Created in thread_start(), once
+   malloc() is up. */
+static struct slab *thread_slab;
+
+/* Number of thread pages preloaded into thread_slab at boot, so
+   early spawns skip the page allocator. */
+#define THREAD_POOL_RESERVE 8
+
+/* Advanced (MLFQS) scheduler state.
+
+   The tick handler keeps only O(1) state current: the running
+   thread's recent_cpu and priority, and once per second the
+   global load average, the recent_cpu decay factor derived from
+   it, and the epoch counter.  Every other thread's recent_cpu is
+   brought up to date lazily -- at unblock, at nice changes, and
+   when userland asks -- by mlfqs_refresh(), which applies the
+   decay once per missed epoch.  Interrupt-context work is thus
+   constant no matter how many threads exist. */
+static fixed_point_t load_avg;          /* System load average. */
+static fixed_point_t mlfqs_decay;       /* Per-second recent_cpu decay,
+                                           2*load_avg / (2*load_avg + 1). */
+static unsigned mlfqs_epoch;            /* Seconds since boot. */
+static unsigned mlfqs_tick_cnt;         /* Ticks into the current second. */
+static size_t ready_thread_cnt;         /* Threads ready (not running). */
+
+/* A thread more than this many epochs stale jumps straight to
+   recent_cpu's steady state instead of decaying step by step. */
+#define MLFQS_DECAY_CAP 32
+
+/* Lock used by allocate_tid(). */
+static struct lock tid_lock;
+
+/* Stack frame for kernel_thread(). */
+struct kernel_thread_frame
+  {
+    void *eip;                  /* Return address. */
+    thread_func *function;      /* Function to call. */
+    void *aux;                  /* Auxiliary data for function. */
+  };
+
+/* Statistics. */
+static long long idle_ticks;    /* # of timer ticks spent idle. */
+static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
+static long long user_ticks;    /* # of timer ticks in user programs. */
+
+/* Scheduling. */
+#define TIME_SLICE 4            /* # of timer ticks to give each thread. */
+static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+
+/* If false (default), use round-robin scheduler.
+   If true, use multi-level feedback queue scheduler.
+   Controlled by kernel command-line option "-o mlfqs". */
+bool thread_mlfqs;
+
+static void kernel_thread (thread_func *, void *aux);
+
+static void idle (void *aux UNUSED);
+static struct thread *running_thread (void);
+static struct thread *next_thread_to_run (void);
+static void init_thread (struct thread *, const char *name, int priority);
+static bool is_thread (struct thread *) UNUSED;
+static void *alloc_frame (struct thread *, size_t size);
+static void schedule (void);
+void thread_schedule_tail (struct thread *prev);
+static tid_t allocate_tid (void);
+static void ready_queue_push (struct ready_queue *, struct thread *);
+static struct thread *ready_queue_pop (struct ready_queue *);
+static struct thread *ready_queue_steal (void);
+static int ready_queue_top (struct ready_queue *);
+static int mlfqs_priority (struct thread *);
+static void mlfqs_refresh (struct thread *);
+
+/* Initializes the threading system by transforming the code
+   that's currently running into a thread.  This can't work in
+   general and it is possible in this case only because loader.S
+   was careful to put the bottom of the stack at a page boundary.
+
+   Also initializes the run queue and the tid lock.
+
+   After calling this function, be sure to initialize the page
+   allocator before trying to create any threads with
+   thread_create().
+
+   It is not safe to call thread_current() until this function
+   finishes. */
+void
+thread_init (void)
+{
+  size_t cpu;
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock_init (&tid_lock);
+  for (cpu = 0; cpu < CPU_CNT; cpu++)
+    {
+      struct ready_queue *rq = &ready_queues[cpu];
+
+      for (i = PRI_MIN; i <= PRI_MAX; i++)
+        list_init (&rq->lists[i]);
+      rq->bitmap = 0;
+      rq->idle_thread = NULL;
+    }
+  list_init (&all_list);
+
+  /* Set up a thread structure for the running thread. */
+  initial_thread = running_thread ();
+  init_thread (initial_thread, "main", PRI_DEFAULT);
+  initial_thread->status = THREAD_RUNNING;
+  initial_thread->tid = allocate_tid ();
+}
+
+/* Starts preemptive thread scheduling by enabling interrupts.
+   Also creates the idle thread. */
+void
+thread_start (void)
+{
+  struct semaphore idle_started;
+
+  /* Set up the cache of thread pages, and preload it so that the
+     first spawns after boot pop a recycled page instead of paying
+     the page allocator on the critical path.  Past the reserve
+     the cache reaches steady state on its own: every exited
+     thread's page comes back to it. */
+  thread_slab = slab_create ("thread", PGSIZE);
+  if (thread_slab == NULL)
+    PANIC ("couldn't create thread slab");
+  slab_reserve (thread_slab, THREAD_POOL_RESERVE);
+
+  /* Create the idle thread. */
+  sema_init (&idle_started, 0);
+  thread_create ("idle", PRI_MIN, idle, &idle_started);
+
+  /* Start preemptive thread scheduling. */
+  intr_enable ();
+
+  /* Wait for the idle thread to initialize idle_thread. */
+  sema_down (&idle_started);
+}
+
+/* Called by the timer interrupt handler at each timer tick.
+   Thus, this function runs in an external interrupt context. */
+void
+thread_tick (void)
+{
+  struct thread *t = thread_current ();
+
+  /* Update statistics. */
+  if (t == ready_queue_current ()->idle_thread)
+    idle_ticks++;
+#ifdef USERPROG
+  else if (t->pagedir != NULL)
+    user_ticks++;
+#endif
+  else
+    kernel_ticks++;
+
+  if (thread_mlfqs)
+    {
+      struct ready_queue *rq = ready_queue_current ();
+
+      /* Once a second, refresh the global load average, the
+         decay factor, and the epoch.  Individual threads catch
+         up lazily in mlfqs_refresh(). */
+      if (++mlfqs_tick_cnt >= TIMER_FREQ)
+        {
+          size_t ready = ready_thread_cnt;
+
+          if (t != rq->idle_thread)
+            ready++;
+          load_avg = fp_mul (fp_div (fp_from_int (59), fp_from_int (60)),
+                             load_avg)
+            + fp_mul (fp_div (fp_from_int (1), fp_from_int (60)),
+                      fp_from_int (ready));
+          mlfqs_decay = fp_div (2 * load_avg, fp_add_int (2 * load_avg, 1));
+          mlfqs_epoch++;
+          mlfqs_tick_cnt = 0;
+        }
+
+      /* Charge this tick to the running thread and reprioritize
+         it every fourth tick.  Only the running thread is
+         touched, so this is O(1). */
+      if (t != rq->idle_thread)
+        {
+          mlfqs_refresh (t);
+          t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+          if (mlfqs_tick_cnt % 4 == 0)
+            thread_update_priority (t, mlfqs_priority (t));
+        }
+    }
+
+  /* Enforce preemption. */
+  if (++thread_ticks >= TIME_SLICE)
+    intr_yield_on_return ();
+}
+
+/* Prints thread statistics. */
+void
+thread_print_stats (void)
+{
+  printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
+          idle_ticks, kernel_ticks, user_ticks);
+}
+
+/* Creates a new kernel thread named NAME with the given initial
+   PRIORITY, which executes FUNCTION passing AUX as the argument,
+   and adds it to the ready queue.  Returns the thread identifier
+   for the new thread, or TID_ERROR if creation fails.
+
+   If thread_start() has been called, then the new thread may be
+   scheduled before thread_create() returns.  It could even exit
+   before thread_create() returns.  Contrariwise, the original
+   thread may run for any amount of time before the new thread is
+   scheduled.  Use a semaphore or some other form of
+   synchronization if you need to ensure ordering.
+
+   The code provided sets the new thread's `priority' member to
+   PRIORITY, but no actual priority scheduling is implemented.
+   Priority scheduling is the goal of Problem 1-3. */
+tid_t
+thread_create (const char *name, int priority,
+               thread_func *function, void *aux)
+{
+  struct thread *t;
+  struct kernel_thread_frame *kf;
+  struct switch_entry_frame *ef;
+  struct switch_threads_frame *sf;
+  tid_t tid;
+
+  ASSERT (function != NULL);
+
+  /* Allocate thread.  init_thread() clears the structure itself;
+     the rest of the page is stack and needs no clearing. */
+  t = slab_alloc (thread_slab);
+  if (t == NULL)
+    return TID_ERROR;
+
+  /* Initialize thread. */
+  init_thread (t, name, priority);
+  tid = t->tid = allocate_tid ();
+  if (thread_mlfqs)
+    {
+      /* Niceness and recent CPU are inherited from the creating
+         thread. */
+      t->nice = thread_current ()->nice;
+      t->recent_cpu = thread_current ()->recent_cpu;
+      t->recent_cpu_epoch = mlfqs_epoch;
+    }
+
+  /* Stack frame for kernel_thread(). */
+  kf = alloc_frame (t, sizeof *kf);
+  kf->eip = NULL;
+  kf->function = function;
+  kf->aux = aux;
+
+  /* Stack frame for switch_entry(). */
+  ef = alloc_frame (t, sizeof *ef);
+  ef->eip = (void (*) (void)) kernel_thread;
+
+  /* Stack frame for switch_threads(). */
+  sf = alloc_frame (t, sizeof *sf);
+  sf->eip = switch_entry;
+  sf->ebp = 0;
+
+  /* Add to run queue. */
+  thread_unblock (t);
+
+  return tid;
+}
+
+/* Puts the current thread to sleep.  It will not be scheduled
+   again until awoken by thread_unblock().
+
+   This function must be called with interrupts turned off.  It
+   is usually a better idea to use one of the synchronization
+   primitives in synch.h. */
+void
+thread_block (void)
+{
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  thread_current ()->status = THREAD_BLOCKED;
+  schedule ();
+}
+
+/* Transitions a blocked thread T to the ready-to-run state.
+   This is an error if T is not blocked.  (Use thread_yield() to
+   make the running thread ready.)
+
+   This function does not preempt the running thread.  This can
+   be important: if the caller had disabled interrupts itself,
+   it may expect that it can atomically unblock a thread and
+   update other data. */
+void
+thread_unblock (struct thread *t)
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+
+  old_level = intr_disable ();
+  ASSERT (t->status == THREAD_BLOCKED);
+  if (thread_mlfqs)
+    {
+      /* Settle the decay T missed while blocked, so it queues at
+         the priority it deserves now. */
+      mlfqs_refresh (t);
+      t->priority = mlfqs_priority (t);
+    }
+  /* On a multiprocessor this is where a target CPU would be
+     chosen; with one CPU every thread lands on its queue. */
+  ready_queue_push (ready_queue_current (), t);
+  t->status = THREAD_READY;
+  intr_set_level (old_level);
+}
+
+/* Returns the name of the running thread. */
+const char *
+thread_name (void)
+{
+  return thread_current ()->name;
+}
+
+/* Returns the running thread.
+   This is running_thread() plus a couple of sanity checks.
+   See the big comment at the top of thread.h for details. */
+struct thread *
+thread_current (void)
+{
+  struct thread *t = running_thread ();
+
+  /* Make sure T is really a thread.
+     If either of these assertions fire, then your thread may
+     have overflowed its stack.  Each thread has less than 4 kB
+     of stack, so a few big automatic arrays or moderate
+     recursion can cause stack overflow. */
+  ASSERT (is_thread (t));
+  ASSERT (t->status == THREAD_RUNNING);
+
+  return t;
+}
+
+/* Returns the running thread's tid. */
+tid_t
+thread_tid (void)
+{
+  return thread_current ()->tid;
+}
+
+/* Deschedules the current thread and destroys it.  Never
+   returns to the caller. */
+void
+thread_exit (void)
+{
+  ASSERT (!intr_context ());
+
+#ifdef USERPROG
+  process_exit ();
+#endif
+
+  /* Return any blocks cached in our malloc() magazines. */
+  malloc_thread_exit ();
+
+  /* Remove thread from all threads list, set our status to dying,
+     and schedule another process.  That process will destroy us
+     when it calls thread_schedule_tail(). */
+  intr_disable ();
+  list_remove (&thread_current()->allelem);
+  thread_current ()->status = THREAD_DYING;
+  schedule ();
+  NOT_REACHED ();
+}
+
+/* Yields the CPU.  The current thread is not put to sleep and
+   may be scheduled again immediately at the scheduler's whim. */
+void
+thread_yield (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  if (cur != ready_queue_current ()->idle_thread)
+    ready_queue_push (ready_queue_current (), cur);
+  cur->status = THREAD_READY;
+  schedule ();
+  intr_set_level (old_level);
+}
+
+/* Invoke function 'func' on all threads, passing along 'aux'.
+   This function must be called with interrupts off. */
+void
+thread_foreach (thread_action_func *func, void *aux)
+{
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      func (t, aux);
+    }
+}
+
+/* Sets the current thread's base priority to NEW_PRIORITY.  The
+   effective priority stays higher while lock waiters are
+   donating to us.  If the run queue now holds a higher-priority
+   thread, yields to it; the check is a bitmap lookup, so
+   repriortizing is O(1). */
+void
+thread_set_priority (int new_priority)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool should_yield;
+
+  ASSERT (new_priority >= PRI_MIN && new_priority <= PRI_MAX);
+
+  /* The advanced scheduler sets priorities itself. */
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_update_priority (cur, thread_compute_priority (cur));
+  should_yield = ready_queue_top (ready_queue_current ()) > cur->priority;
+  intr_set_level (old_level);
+
+  if (should_yield)
+    thread_yield ();
+}
+
+/* Sets T's effective priority to NEW_PRIORITY, moving it to the
+   matching ready list if it is queued to run.  Called both for
+   priority donation (synch.c) and for plain priority changes.
+   Interrupts must be off. */
+void
+thread_update_priority (struct thread *t, int new_priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (new_priority >= PRI_MIN && new_priority <= PRI_MAX);
+
+  if (t->priority == new_priority)
+    return;
+
+  if (t->status == THREAD_READY)
+    {
+      /* Requeue under the new priority.  Every ready thread is
+         on the current CPU's queue while CPU_CNT is 1; a
+         multi-CPU build must track the owning queue instead. */
+      struct ready_queue *rq = ready_queue_current ();
+
+      list_remove (&t->elem);
+      if (list_empty (&rq->lists[t->priority]))
+        rq->bitmap &= ~((uint64_t) 1 << t->priority);
+      ready_thread_cnt--;
+      t->priority = new_priority;
+      ready_queue_push (rq, t);
+    }
+  else
+    t->priority = new_priority;
+}
+
+/* Returns the priority T should run at: its base priority, or
+   the highest priority among threads waiting on locks T holds,
+   whichever is greater.  Interrupts must be off so that the
+   waiter lists are stable. */
+int
+thread_compute_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&t->locks_held); e != list_end (&t->locks_held);
+       e = list_next (e))
+    {
+      struct lock *l = list_entry (e, struct lock, elem);
+      struct list_elem *w;
+
+      for (w = list_begin (&l->semaphore.waiters);
+           w != list_end (&l->semaphore.waiters); w = list_next (w))
+        {
+          struct thread *waiter = list_entry (w, struct thread, elem);
+
+          if (waiter->priority > priority)
+            priority = waiter->priority;
+        }
+    }
+  return priority;
+}
+
+/* Returns the current thread's priority. */
+int
+thread_get_priority (void)
+{
+  return thread_current ()->priority;
+}
+
+/* Returns the priority the MLFQS formula assigns to T, clamped
+   to the valid range.  T's recent_cpu must be current. */
+static int
+mlfqs_priority (struct thread *t)
+{
+  int priority = PRI_MAX - fp_to_int_round (t->recent_cpu / 4)
+    - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  return priority;
+}
+
+/* Brings T's recent_cpu up to the current epoch, applying the
+   per-second decay once for each second T went untouched.  A
+   thread stale past MLFQS_DECAY_CAP jumps straight to the steady
+   state nice * (2*load_avg + 1) that repeated decay converges
+   to.  Missed epochs use the current decay factor rather than
+   each epoch's own, a deliberate approximation that keeps the
+   tick handler from having to visit every thread.  Interrupts
+   must be off. */
+static void
+mlfqs_refresh (struct thread *t)
+{
+  unsigned behind = mlfqs_epoch - t->recent_cpu_epoch;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (behind == 0)
+    return;
+  if (behind > MLFQS_DECAY_CAP)
+    t->recent_cpu = fp_mul (fp_from_int (t->nice),
+                            fp_add_int (2 * load_avg, 1));
+  else
+    while (behind-- > 0)
+      t->recent_cpu = fp_add_int (fp_mul (mlfqs_decay, t->recent_cpu),
+                                  t->nice);
+  t->recent_cpu_epoch = mlfqs_epoch;
+}
+
+/* Sets the current thread's nice value to NICE and
+   reprioritizes it, yielding if it no longer ranks highest. */
+void
+thread_set_nice (int nice)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool should_yield;
+
+  ASSERT (nice >= -20 && nice <= 20);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  mlfqs_refresh (cur);
+  thread_update_priority (cur, mlfqs_priority (cur));
+  should_yield = ready_queue_top (ready_queue_current ()) > cur->priority;
+  intr_set_level (old_level);
+
+  if (should_yield)
+    thread_yield ();
+}
+
+/* Returns the current thread's nice value. */
+int
+thread_get_nice (void)
+{
+  return thread_current ()->nice;
+}
+
+/* Returns 100 times the system load average. */
+int
+thread_get_load_avg (void)
+{
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fp_to_int_round (100 * load_avg);
+
+  intr_set_level (old_level);
+  return load_avg_100;
+}
+
+/* Returns 100 times the current thread's recent_cpu value. */
+int
+thread_get_recent_cpu (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100;
+
+  mlfqs_refresh (cur);
+  recent_cpu_100 = fp_to_int_round (100 * cur->recent_cpu);
+  intr_set_level (old_level);
+  return recent_cpu_100;
+}
+
+/* Idle thread.  Executes when no other thread is ready to run.
+
+   The idle thread is initially put on the ready list by
+   thread_start().  It will be scheduled once initially, at which
+   point it initializes idle_thread, "up"s the semaphore passed
+   to it to enable thread_start() to continue, and immediately
+   blocks.  After that, the idle thread never appears in the
+   ready list.  It is returned by next_thread_to_run() as a
+   special case when the ready list is empty. */
+static void
+idle (void *idle_started_ UNUSED)
+{
+  struct semaphore *idle_started = idle_started_;
+  ready_queue_current ()->idle_thread = thread_current ();
+  sema_up (idle_started);
+
+  for (;;)
+    {
+      /* Let someone else run. */
+      intr_disable ();
+      thread_block ();
+
+      /* Re-enable interrupts and wait for the next one.
+
+         The `sti' instruction disables interrupts until the
+         completion of the next instruction, so these two
+         instructions are executed atomically.  This atomicity is
+         important; otherwise, an interrupt could be handled
+         between re-enabling interrupts and waiting for the next
+         one to occur, wasting as much as one clock tick worth of
+         time.
+
+         See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
+         7.11.1 "HLT Instruction". */
+      asm volatile ("sti; hlt" : : : "memory");
+    }
+}
+
+/* Function used as the basis for a kernel thread. */
+static void
+kernel_thread (thread_func *function, void *aux)
+{
+  ASSERT (function != NULL);
+
+  intr_enable ();       /* The scheduler runs with interrupts off. */
+  function (aux);       /* Execute the thread function. */
+  thread_exit ();       /* If function() returns, kill the thread. */
+}
+
+/* Returns the running thread. */
+static struct thread *
+running_thread (void)
+{
+  uint32_t *esp;
+
+  /* Copy the CPU's stack pointer into `esp', and then round that
+     down to the start of a page.  Because `struct thread' is
+     always at the beginning of a page and the stack pointer is
+     somewhere in the middle, this locates the curent thread. */
+  asm ("mov %%esp, %0" : "=g" (esp));
+  return pg_round_down (esp);
+}
+
+/* Returns true if T appears to point to a valid thread. */
+static bool
+is_thread (struct thread *t)
+{
+  return t != NULL && t->magic == THREAD_MAGIC;
+}
+
+/* Does basic initialization of T as a blocked thread named
+   NAME. */
+static void
+init_thread (struct thread *t, const char *name, int priority)
+{
+  enum intr_level old_level;
+
+  ASSERT (t != NULL);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+  ASSERT (name != NULL);
+
+  memset (t, 0, sizeof *t);
+  t->status = THREAD_BLOCKED;
+  strlcpy (t->name, name, sizeof t->name);
+  t->stack = (uint8_t *) t + PGSIZE;
+  t->priority = priority;
+  t->base_priority = priority;
+  list_init (&t->locks_held);
+  t->magic = THREAD_MAGIC;
+#ifdef USERPROG
+  list_init (&t->children);
+  list_init (&t->fds);
+  t->next_handle = 2;
+#endif
+#ifdef VM
+  list_init (&t->mmaps);
+  t->next_mapid = 1;
+#endif
+
+  old_level = intr_disable ();
+  list_push_back (&all_list, &t->allelem);
+  intr_set_level (old_level);
+}
+
+/* Allocates a SIZE-byte frame at the top of thread T's stack and
+   returns a pointer to the frame's base. */
+static void *
+alloc_frame (struct thread *t, size_t size)
+{
+  /* Stack data is always allocated in word-size units. */
+  ASSERT (is_thread (t));
+  ASSERT (size % sizeof (uint32_t) == 0);
+
+  t->stack -= size;
+  return t->stack;
+}
+
+/* Adds T, which must be ready to run, to run queue RQ.
+   Interrupts must be off. */
+static void
+ready_queue_push (struct ready_queue *rq, struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->priority >= PRI_MIN && t->priority <= PRI_MAX);
+
+  list_push_back (&rq->lists[t->priority], &t->elem);
+  rq->bitmap |= (uint64_t) 1 << t->priority;
+  ready_thread_cnt++;
+}
+
+/* Removes and returns the highest-priority thread ready on RQ,
+   or a null pointer if RQ is empty.  Interrupts must be off. */
+static struct thread *
+ready_queue_pop (struct ready_queue *rq)
+{
+  struct list *q;
+  struct thread *t;
+  int priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (rq->bitmap == 0)
+    return NULL;
+
+  priority = 63 - __builtin_clzll (rq->bitmap);
+  q = &rq->lists[priority];
+  t = list_entry (list_pop_front (q), struct thread, elem);
+  if (list_empty (q))
+    rq->bitmap &= ~((uint64_t) 1 << priority);
+  ready_thread_cnt--;
+  return t;
+}
+
+/* Work-stealing balancer: when our own queue is empty, takes the
+   highest-priority ready thread from the most loaded other
+   queue.  Returns a stolen thread or a null pointer.  With one
+   CPU there is never another queue to steal from, so this
+   compiles down to nothing. */
+static struct thread *
+ready_queue_steal (void)
+{
+  struct ready_queue *victim = NULL;
+  size_t cpu;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (cpu = 0; cpu < CPU_CNT; cpu++)
+    {
+      struct ready_queue *rq = &ready_queues[cpu];
+
+      if (rq == ready_queue_current () || rq->bitmap == 0)
+        continue;
+      if (victim == NULL || ready_queue_top (rq) > ready_queue_top (victim))
+        victim = rq;
+    }
+
+  return victim != NULL ? ready_queue_pop (victim) : NULL;
+}
+
+/* Returns the priority of the highest-priority thread ready on
+   RQ, or PRI_MIN - 1 if RQ is empty. */
+static int
+ready_queue_top (struct ready_queue *rq)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (rq->bitmap == 0)
+    return PRI_MIN - 1;
+  return 63 - __builtin_clzll (rq->bitmap);
+}
+
+/* Chooses and returns the next thread to be scheduled.  Should
+   return a thread from this CPU's run queue, unless it is empty.
+   (If the running thread can continue running, then it will be
+   in the run queue.)  An empty queue first tries to steal from
+   another CPU and only then falls back to this CPU's idle
+   thread. */
+static struct thread *
+next_thread_to_run (void)
+{
+  struct ready_queue *rq = ready_queue_current ();
+  struct thread *t = ready_queue_pop (rq);
+
+  if (t == NULL)
+    t = ready_queue_steal ();
+  return t != NULL ? t : rq->idle_thread;
+}
+
+/* Completes a thread switch by activating the new thread's page
+   tables, and, if the previous thread is dying, destroying it.
+
+   At this function's invocation, we just switched from thread
+   PREV, the new thread is already running, and interrupts are
+   still disabled.  This function is normally invoked by
+   thread_schedule() as its final action before returning, but
+   the first time a thread is scheduled it is called by
+   switch_entry() (see switch.S).
+
+   It's not safe to call printf() until the thread switch is
+   complete.  In practice that means that printf()s should be
+   added at the end of the function.
+
+   After this function and its caller returns, the thread switch
+   is complete. */
+void
+thread_schedule_tail (struct thread *prev)
+{
+  struct thread *cur = running_thread ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Mark us as running. */
+  cur->status = THREAD_RUNNING;
+
+  /* Start new time slice. */
+  thread_ticks = 0;
+
+#ifdef USERPROG
+  /* Activate the new address space. */
+  process_activate ();
+#endif
+
+  /* If the thread we switched from is dying, destroy its struct
+     thread.  This must happen late so that thread_exit() doesn't
+     pull out the rug under itself.  (We don't free
+     initial_thread because its memory was not obtained from the
+     thread slab.) */
+  if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
+    {
+      ASSERT (prev != cur);
+      slab_free (thread_slab, prev);
+    }
+}
+
+/* Schedules a new process.  At entry, interrupts must be off and
+   the running process's state must have been changed from
+   running to some other state.  This function finds another
+   thread to run and switches to it.
+
+   It's not safe to call printf() until thread_schedule_tail()
+   has completed. */
+static void
+schedule (void)
+{
+  struct thread *cur = running_thread ();
+  struct thread *next = next_thread_to_run ();
+  struct thread *prev = NULL;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (cur->status != THREAD_RUNNING);
+  ASSERT (is_thread (next));
+
+  if (cur != next)
+    {
+      trace_event (TRACE_CTX_SWITCH, next->tid);
+      prev = switch_threads (cur, next);
+    }
+  thread_schedule_tail (prev);
+}
+
+/* Returns a tid to use for a new thread. */
+static tid_t
+allocate_tid (void)
+{
+  static tid_t next_tid = 1;
+  tid_t tid;
+
+  lock_acquire (&tid_lock);
+  tid = next_tid++;
+  lock_release (&tid_lock);
+
+  return tid;
+}
+
+/* Offset of `stack' member within `struct thread'.
+   Used by switch.S, which can't figure it out on its own. */
+uint32_t thread_stack_ofs = offsetof (struct thread, stack);
@@ -0,0 +1,108 @@
+#include "threads/trace.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Kernel flight recorder.
+
+   Each CPU owns a ring of fixed-size records; logging an event
+   is a cycle-counter read and four stores with interrupts
+   briefly off, cheap enough to leave compiled in.  The ring
+   overwrites its oldest records, so after a hang or a slow run
+   the recent history is still there to be dumped -- through
+   trace_dump(), wired to the "trace-dump" kernel action, or by
+   reading the `rings' array from a debugger post-mortem.
+
+   printf()-based probing perturbs what it measures by dragging
+   every event through the serial path; records here cost tens of
+   cycles and are only formatted at dump time. */
+
+/* One ring per CPU; mirrors CPU_CNT in thread.c. */
+#define TRACE_CPU_CNT 1
+
+/* Records per ring.  A power of 2, so the write index wraps with
+   a mask. */
+#define TRACE_BUFSIZE 4096
+
+/* A single trace record, 16 bytes. */
+struct trace_record
+  {
+    uint64_t tsc;               /* Cycle counter at the event. */
+    uint32_t arg;               /* Event argument. */
+    int16_t id;                 /* enum trace_id. */
+    int16_t tid;                /* Thread that logged the event. */
+  };
+
+/* A per-CPU event ring. */
+struct trace_ring
+  {
+    struct trace_record recs[TRACE_BUFSIZE]; /* Records. */
+    unsigned pos;               /* Free-running write index. */
+  };
+
+static struct trace_ring rings[TRACE_CPU_CNT];
+
+/* Human-readable event names, indexed by enum trace_id. */
+static const char *trace_names[TRACE_ID_CNT] =
+  {
+    "ctx-switch",
+    "page-fault",
+    "fault-done",
+    "syscall",
+    "block-read",
+    "block-write",
+  };
+
+/* Reads the CPU's cycle counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Logs event ID with argument ARG to the current CPU's ring.
+   Safe from any context, including interrupt handlers and the
+   scheduler. */
+void
+trace_event (enum trace_id id, uint32_t arg)
+{
+  enum intr_level old_level = intr_disable ();
+  struct trace_ring *ring = &rings[0];  /* cpu_id() once CPU_CNT > 1. */
+  struct trace_record *r = &ring->recs[ring->pos++ % TRACE_BUFSIZE];
+
+  r->tsc = rdtsc ();
+  r->arg = arg;
+  r->id = id;
+  r->tid = thread_tid ();
+  intr_set_level (old_level);
+}
+
+/* Prints every recorded event, oldest first.  Invoked by the
+   "trace-dump" kernel action; the output lands in the serial log
+   alongside the rest of the run. */
+void
+trace_dump (void)
+{
+  size_t cpu;
+
+  for (cpu = 0; cpu < TRACE_CPU_CNT; cpu++)
+    {
+      struct trace_ring *ring = &rings[cpu];
+      unsigned cnt = ring->pos < TRACE_BUFSIZE ? ring->pos : TRACE_BUFSIZE;
+      unsigned first = ring->pos - cnt;
+      unsigned i;
+
+      printf ("Trace: cpu %zu, %u events\n", cpu, cnt);
+      for (i = 0; i < cnt; i++)
+        {
+          struct trace_record *r = &ring->recs[(first + i) % TRACE_BUFSIZE];
+
+          printf ("%016"PRIu64"  %-11s  tid=%d  arg=0x%08"PRIx32"\n",
+                  r->tsc, trace_names[r->id], r->tid, r->arg);
+        }
+    }
+}
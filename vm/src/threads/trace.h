@@ -0,0 +1,30 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdint.h>
+
+/* Kernel event tracing.
+
+   A low-overhead flight recorder: trace_event() appends a
+   timestamped record to a per-CPU ring buffer that overwrites
+   its oldest entries, so the recent past is always available for
+   dumping -- on demand via the "trace-dump" kernel action, or
+   post-mortem from a debugger or an emulator log.  See trace.c
+   for the record format. */
+
+/* Event identifiers. */
+enum trace_id
+  {
+    TRACE_CTX_SWITCH,           /* Context switch; ARG is next tid. */
+    TRACE_PAGE_FAULT,           /* Page fault entry; ARG is fault address. */
+    TRACE_PAGE_FAULT_DONE,      /* Page fault resolved; ARG is address. */
+    TRACE_SYSCALL,              /* Syscall dispatch; ARG is call number. */
+    TRACE_BLOCK_READ,           /* Block device read; ARG is sector. */
+    TRACE_BLOCK_WRITE,          /* Block device write; ARG is sector. */
+    TRACE_ID_CNT
+  };
+
+void trace_event (enum trace_id, uint32_t arg);
+void trace_dump (void);
+
+#endif /* threads/trace.h */
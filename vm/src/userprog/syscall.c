@@ -0,0 +1,633 @@
+#include "userprog/syscall.h"
+#include <stdio.h>
+#include <string.h>
+#include <syscall-nr.h>
+#include "devices/input.h"
+#include "devices/shutdown.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+
+static void syscall_handler (struct intr_frame *);
+
+/* A file descriptor, for binding a file handle to a file. */
+struct file_descriptor
+  {
+    struct list_elem elem;      /* List element. */
+    struct file *file;          /* File. */
+    int handle;                 /* File handle. */
+  };
+
+/* A memory-mapped file, from mmap to munmap. */
+struct mapping
+  {
+    struct list_elem elem;      /* List element. */
+    int id;                     /* Mapping id. */
+    struct file *file;          /* File. */
+    uint8_t *base;              /* Start of memory mapping. */
+    size_t page_cnt;            /* Number of pages mapped. */
+  };
+
+static int sys_halt (void);
+static int sys_exit (int status);
+static int sys_exec (const char *ufile);
+static int sys_fork (struct intr_frame *);
+static int sys_wait (tid_t);
+static int sys_create (const char *ufile, unsigned initial_size);
+static int sys_remove (const char *ufile);
+static int sys_open (const char *ufile);
+static int sys_filesize (int handle);
+static int sys_read (int handle, void *udst_, unsigned size);
+static int sys_write (int handle, void *usrc_, unsigned size);
+static int sys_seek (int handle, unsigned position);
+static int sys_tell (int handle);
+static int sys_close (int handle);
+static int sys_mmap (int handle, void *addr);
+static int sys_munmap (int mapping);
+
+static struct file_descriptor *lookup_fd (int handle);
+static struct mapping *lookup_mapping (int id);
+static void unmap (struct mapping *m);
+static void verify_user_range (const void *uaddr, size_t size);
+static char *copy_in_string (const char *us);
+static void copy_in (void *dst_, const void *usrc_, size_t size);
+static void copy_out (void *udst_, const void *src_, size_t size);
+
+void
+syscall_init (void)
+{
+  intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+}
+
+/* System call handler. */
+static void
+syscall_handler (struct intr_frame *f)
+{
+  typedef int syscall_function (int, int, int);
+
+  /* A system call. */
+  struct syscall
+    {
+      size_t arg_cnt;           /* Number of arguments. */
+      syscall_function *func;   /* Implementation. */
+    };
+
+  /* Table of system calls. */
+  static const struct syscall syscall_table[] =
+    {
+      {0, (syscall_function *) sys_halt},
+      {1, (syscall_function *) sys_exit},
+      {1, (syscall_function *) sys_exec},
+      {1, (syscall_function *) sys_wait},
+      {2, (syscall_function *) sys_create},
+      {1, (syscall_function *) sys_remove},
+      {1, (syscall_function *) sys_open},
+      {1, (syscall_function *) sys_filesize},
+      {3, (syscall_function *) sys_read},
+      {3, (syscall_function *) sys_write},
+      {2, (syscall_function *) sys_seek},
+      {1, (syscall_function *) sys_tell},
+      {1, (syscall_function *) sys_close},
+      {2, (syscall_function *) sys_mmap},
+      {1, (syscall_function *) sys_munmap},
+    };
+
+  const struct syscall *sc;
+  unsigned call_nr;
+  int args[3];
+
+  /* Remember the user stack pointer, for page faults taken while
+     the kernel touches user memory on this thread's behalf. */
+  thread_current ()->user_esp = f->esp;
+
+  /* Get the system call. */
+  copy_in (&call_nr, f->esp, sizeof call_nr);
+  trace_event (TRACE_SYSCALL, call_nr);
+
+  /* Fork is dispatched outside the table: it needs the whole
+     interrupt frame, since the child resumes from the parent's
+     user context. */
+  if (call_nr == SYS_FORK)
+    {
+      f->eax = sys_fork (f);
+      return;
+    }
+
+  if (call_nr >= sizeof syscall_table / sizeof *syscall_table)
+    syscall_exit (-1);
+  sc = syscall_table + call_nr;
+
+  /* Get the system call arguments. */
+  ASSERT (sc->arg_cnt <= sizeof args / sizeof *args);
+  memset (args, 0, sizeof args);
+  copy_in (args, (uint32_t *) f->esp + 1, sizeof *args * sc->arg_cnt);
+
+  /* Execute the system call, and set the return value. */
+  f->eax = sc->func (args[0], args[1], args[2]);
+}
+
+/* Verifies that [UADDR, UADDR + SIZE) lies below PHYS_BASE and
+   does not wrap around; kills the process if not.  This is the
+   only check made before the kernel dereferences a user span:
+   whether each page is actually mapped is left to the MMU, and a
+   fault the VM layer cannot resolve kills the process from
+   page_fault().  A 64 kB write thus costs one range check
+   instead of a page table probe per page.
+
+   Because such a fault can kill without unwinding, user spans
+   may only be dereferenced where no locks are held: sys_read and
+   sys_write stage file data through kernel pages instead of
+   passing user buffers into the filesys. */
+static void
+verify_user_range (const void *uaddr, size_t size)
+{
+  const uint8_t *end = (const uint8_t *) uaddr + size;
+
+  if (size == 0)
+    return;
+  if (!is_user_vaddr ((const void *) (end - 1)) || end < (uint8_t *) uaddr)
+    syscall_exit (-1);
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST; kills the process if any of USRC is invalid. */
+static void
+copy_in (void *dst_, const void *usrc_, size_t size)
+{
+  verify_user_range (usrc_, size);
+  memcpy (dst_, usrc_, size);
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST; kills the process if any of UDST is invalid or
+   read-only. */
+static void
+copy_out (void *udst_, const void *src_, size_t size)
+{
+  verify_user_range (udst_, size);
+  memcpy (udst_, src_, size);
+}
+
+/* Creates a copy of user string US in kernel memory and returns
+   it as a page that must be freed with palloc_free_page().
+   Kills the process if US is invalid or longer than PGSIZE
+   bytes.  The string is copied a page-sized span at a time, so
+   the cost is one bounds check per page rather than per byte. */
+static char *
+copy_in_string (const char *us)
+{
+  char *ks;
+  size_t length = 0;
+
+  ks = palloc_get_page (0);
+  if (ks == NULL)
+    syscall_exit (-1);
+
+  while (length < PGSIZE)
+    {
+      size_t page_left = PGSIZE - pg_ofs (us + length);
+      size_t chunk = page_left < PGSIZE - length
+        ? page_left : PGSIZE - length;
+
+      verify_user_range (us + length, chunk);
+      memcpy (ks + length, us + length, chunk);
+      if (memchr (ks + length, '\0', chunk) != NULL)
+        return ks;
+      length += chunk;
+    }
+  ks[PGSIZE - 1] = '\0';
+  return ks;
+}
+
+/* Halt system call. */
+static int
+sys_halt (void)
+{
+  shutdown_power_off ();
+}
+
+/* Exit, for internal kernel use: records STATUS and terminates
+   the current process. */
+void
+syscall_exit (int status)
+{
+  struct thread *cur = thread_current ();
+
+  cur->wait_status->exit_code = status;
+  thread_exit ();
+  NOT_REACHED ();
+}
+
+/* Exit system call. */
+static int
+sys_exit (int status)
+{
+  syscall_exit (status);
+  NOT_REACHED ();
+}
+
+/* Exec system call. */
+static int
+sys_exec (const char *ufile)
+{
+  tid_t tid;
+  char *kfile = copy_in_string (ufile);
+
+  tid = process_execute (kfile);
+  palloc_free_page (kfile);
+
+  return tid;
+}
+
+/* Fork system call. */
+static int
+sys_fork (struct intr_frame *f)
+{
+  tid_t tid;
+
+  tid = process_fork (f);
+
+  return tid;
+}
+
+/* Wait system call. */
+static int
+sys_wait (tid_t child)
+{
+  return process_wait (child);
+}
+
+/* Create system call. */
+static int
+sys_create (const char *ufile, unsigned initial_size)
+{
+  char *kfile = copy_in_string (ufile);
+  bool ok;
+
+  ok = filesys_create (kfile, initial_size);
+  palloc_free_page (kfile);
+
+  return ok;
+}
+
+/* Remove system call. */
+static int
+sys_remove (const char *ufile)
+{
+  char *kfile = copy_in_string (ufile);
+  bool ok;
+
+  ok = filesys_remove (kfile);
+  palloc_free_page (kfile);
+
+  return ok;
+}
+
+/* Open system call. */
+static int
+sys_open (const char *ufile)
+{
+  char *kfile = copy_in_string (ufile);
+  struct file_descriptor *fd;
+  int handle = -1;
+
+  fd = malloc (sizeof *fd);
+  if (fd != NULL)
+    {
+      fd->file = filesys_open (kfile);
+      if (fd->file != NULL)
+        {
+          struct thread *cur = thread_current ();
+          handle = fd->handle = cur->next_handle++;
+          list_push_front (&cur->fds, &fd->elem);
+        }
+      else
+        free (fd);
+    }
+
+  palloc_free_page (kfile);
+  return handle;
+}
+
+/* Returns the file descriptor associated with the given handle.
+   Terminates the process if HANDLE is not associated with an
+   open file. */
+static struct file_descriptor *
+lookup_fd (int handle)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&cur->fds); e != list_end (&cur->fds);
+       e = list_next (e))
+    {
+      struct file_descriptor *fd;
+      fd = list_entry (e, struct file_descriptor, elem);
+      if (fd->handle == handle)
+        return fd;
+    }
+
+  syscall_exit (-1);
+  NOT_REACHED ();
+}
+
+/* Filesize system call. */
+static int
+sys_filesize (int handle)
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+  int size;
+
+  size = file_length (fd->file);
+
+  return size;
+}
+
+/* Read system call. */
+static int
+sys_read (int handle, void *udst_, unsigned size)
+{
+  uint8_t *udst = udst_;
+  struct file_descriptor *fd;
+  uint8_t *buf;
+  int bytes_read = 0;
+
+  verify_user_range (udst, size);
+
+  /* Handle keyboard reads, gathering keystrokes into a kernel
+     buffer and copying them out a batch at a time. */
+  if (handle == STDIN_FILENO)
+    {
+      uint8_t buf[64];
+
+      while ((size_t) bytes_read < size)
+        {
+          size_t chunk = size - bytes_read < sizeof buf
+            ? size - bytes_read : sizeof buf;
+          size_t n = 0;
+
+          while (n < chunk)
+            n += input_read (buf + n, chunk - n);
+          copy_out (udst + bytes_read, buf, chunk);
+          bytes_read += chunk;
+        }
+      return bytes_read;
+    }
+
+  /* Handle all other reads.  The data is staged through a kernel
+     page rather than read into the user buffer directly:
+     file_read runs deep in the filesys with inode, cache, and
+     device locks held, and a fault on an unmapped user buffer
+     there would kill the process without ever releasing them,
+     wedging the file system for everyone else.  Touching user
+     memory is confined to copy_out, where no locks are held. */
+  fd = lookup_fd (handle);
+  buf = palloc_get_page (0);
+  if (buf == NULL)
+    return -1;
+  while ((size_t) bytes_read < size)
+    {
+      size_t chunk = size - bytes_read < PGSIZE ? size - bytes_read : PGSIZE;
+      off_t n = file_read (fd->file, buf, chunk);
+
+      if (n > 0)
+        copy_out (udst + bytes_read, buf, n);
+      bytes_read += n;
+      if (n < (off_t) chunk)
+        break;
+    }
+  palloc_free_page (buf);
+
+  return bytes_read;
+}
+
+/* Write system call. */
+static int
+sys_write (int handle, void *usrc_, unsigned size)
+{
+  uint8_t *usrc = usrc_;
+  struct file_descriptor *fd = NULL;
+  uint8_t *buf;
+  int bytes_written = 0;
+
+  verify_user_range (usrc, size);
+
+  /* Lookup up file descriptor. */
+  if (handle != STDOUT_FILENO)
+    fd = lookup_fd (handle);
+
+  /* As in sys_read, the data is staged through a kernel page so
+     that a fault on the user buffer happens here, in copy_in,
+     rather than under the filesys locks inside file_write (or
+     the console lock inside putbuf). */
+  buf = palloc_get_page (0);
+  if (buf == NULL)
+    return -1;
+  while ((size_t) bytes_written < size)
+    {
+      size_t chunk = size - bytes_written < PGSIZE
+        ? size - bytes_written : PGSIZE;
+      off_t n;
+
+      copy_in (buf, usrc + bytes_written, chunk);
+      if (handle == STDOUT_FILENO)
+        {
+          putbuf ((char *) buf, chunk);
+          n = chunk;
+        }
+      else
+        n = file_write (fd->file, buf, chunk);
+      bytes_written += n;
+      if (n < (off_t) chunk)
+        break;
+    }
+  palloc_free_page (buf);
+
+  return bytes_written;
+}
+
+/* Seek system call. */
+static int
+sys_seek (int handle, unsigned position)
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+
+  if ((off_t) position >= 0)
+    file_seek (fd->file, position);
+
+  return 0;
+}
+
+/* Tell system call. */
+static int
+sys_tell (int handle)
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+  unsigned position;
+
+  position = file_tell (fd->file);
+
+  return position;
+}
+
+/* Close system call. */
+static int
+sys_close (int handle)
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+
+  file_close (fd->file);
+  list_remove (&fd->elem);
+  free (fd);
+  return 0;
+}
+
+/* Returns the mapping associated with the given id.
+   Terminates the process if ID is not associated with a
+   mapping. */
+static struct mapping *
+lookup_mapping (int id)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&cur->mmaps); e != list_end (&cur->mmaps);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == id)
+        return m;
+    }
+
+  syscall_exit (-1);
+  NOT_REACHED ();
+}
+
+/* Mmap system call: maps the file open as HANDLE into the
+   process's address space starting at ADDR.  Pages fault in
+   lazily from the file and only dirty pages are written back at
+   unmap time. */
+static int
+sys_mmap (int handle, void *addr)
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+  struct mapping *m = malloc (sizeof *m);
+  struct thread *cur = thread_current ();
+  off_t length;
+  size_t offset;
+
+  if (m == NULL || addr == NULL || pg_ofs (addr) != 0)
+    {
+      free (m);
+      return -1;
+    }
+
+  m->id = cur->next_mapid++;
+  m->file = file_reopen (fd->file);
+  length = m->file != NULL ? file_length (m->file) : 0;
+  if (length <= 0)
+    {
+      file_close (m->file);
+      free (m);
+      return -1;
+    }
+
+  /* The whole range [ADDR, ADDR + LENGTH) must lie below
+     PHYS_BASE, the same bound verify_user_range() enforces; a
+     range that reaches kernel space or wraps around the top of
+     the address space would otherwise create pages the fault
+     handler is happy to map.  An unmappable range is a failed
+     mmap, not a protection violation, so return -1 rather than
+     killing the process. */
+  if (!is_user_vaddr ((uint8_t *) addr + length - 1)
+      || (uint8_t *) addr + length < (uint8_t *) addr)
+    {
+      file_close (m->file);
+      free (m);
+      return -1;
+    }
+  m->base = addr;
+  m->page_cnt = 0;
+  list_push_front (&cur->mmaps, &m->elem);
+
+  for (offset = 0; (off_t) offset < length; offset += PGSIZE)
+    {
+      struct page *p = page_allocate ((uint8_t *) addr + offset, true);
+      size_t read_bytes = length - offset >= PGSIZE
+        ? PGSIZE : (size_t) (length - offset);
+
+      if (p == NULL)
+        {
+          unmap (m);
+          return -1;
+        }
+      page_set_file (p, m->file, offset, read_bytes);
+      m->page_cnt++;
+    }
+
+  return m->id;
+}
+
+/* Removes mapping M from the virtual address space, writing back
+   any pages that have been dirtied.  Clean pages are simply
+   dropped: their contents are already on disk. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  list_remove (&m->elem);
+  pagedir_begin_batch ();
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      struct page *p = page_lookup (m->base + i * PGSIZE);
+
+      ASSERT (p != NULL);
+      page_unmap (p);
+    }
+  pagedir_end_batch ();
+
+  file_close (m->file);
+  free (m);
+}
+
+/* Munmap system call. */
+static int
+sys_munmap (int mapping)
+{
+  unmap (lookup_mapping (mapping));
+  return 0;
+}
+
+/* On thread exit, closes open files and unmaps mappings. */
+void
+syscall_process_exit (void)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e, *next;
+
+  for (e = list_begin (&cur->fds); e != list_end (&cur->fds); e = next)
+    {
+      struct file_descriptor *fd;
+      fd = list_entry (e, struct file_descriptor, elem);
+      next = list_next (e);
+      file_close (fd->file);
+      free (fd);
+    }
+
+  for (e = list_begin (&cur->mmaps); e != list_end (&cur->mmaps); e = next)
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      next = list_next (e);
+      unmap (m);
+    }
+}
@@ -0,0 +1,8 @@
+#ifndef USERPROG_SYSCALL_H
+#define USERPROG_SYSCALL_H
+
+void syscall_init (void);
+void syscall_exit (int status);
+void syscall_process_exit (void);
+
+#endif /* userprog/syscall.h */
@@ -0,0 +1,698 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* All frames holding user pages, in clock order.  The clock hand
+   points at the next frame the eviction scan will examine. */
+static struct list frame_list;
+static struct list_elem *clock_hand;
+static struct lock frame_lock;
+
+/* Frames backing read-only file pages, keyed by
+   (inode, offset).  Processes mapping the same executable page
+   find the existing frame here instead of reading a duplicate
+   copy from disk. */
+static struct hash share_table;
+
+/* Reserve of frames the cleaner thread has already evicted, so a
+   page fault under memory pressure can usually grab one without
+   doing a synchronous swap write of its own.  The cleaner is
+   kicked whenever an allocation finds the user pool empty and
+   refills the reserve up to FRAME_RESERVE_MAX. */
+#define FRAME_RESERVE_MIN 4
+#define FRAME_RESERVE_MAX 8
+static struct list free_frames;
+static size_t free_frame_cnt;
+
+/* Cache of struct frame records. */
+static struct slab *frame_slab;
+static bool cleaner_needed;
+static struct condition cleaner_wakeup;
+
+/* Signaled when a shared frame finishes loading (or its creator
+   gives up and frees it), for processes that found the frame in
+   the share table while it was still being filled. */
+static struct condition load_done;
+
+/* Signaled when the cleaner finishes a swap write for a detached
+   page; see frame_wait_evicted(). */
+static struct condition evict_done;
+
+static struct frame *frame_get (void);
+static struct frame *frame_evict (void);
+static struct frame *frame_select_victim (void);
+static struct frame *clock_next (void);
+static void frame_save (struct frame *);
+static void frame_release (struct frame *);
+static void frame_cleaner (void *aux UNUSED);
+static unsigned share_hash (const struct hash_elem *, void *);
+static bool share_less (const struct hash_elem *, const struct hash_elem *,
+                        void *);
+
+/* Initializes the frame table and starts the background
+   cleaner. */
+void
+frame_init (void)
+{
+  list_init (&frame_list);
+  clock_hand = list_end (&frame_list);
+  lock_init (&frame_lock);
+  hash_init (&share_table, share_hash, share_less, NULL);
+  list_init (&free_frames);
+  free_frame_cnt = 0;
+  cleaner_needed = false;
+  cond_init (&cleaner_wakeup);
+  cond_init (&load_done);
+  cond_init (&evict_done);
+  frame_slab = slab_create ("frame", sizeof (struct frame));
+  if (frame_slab == NULL)
+    PANIC ("couldn't create frame slab");
+  thread_create ("frame-cleaner", PRI_DEFAULT, frame_cleaner, NULL);
+}
+
+/* Allocates a private frame for PAGE and returns it, evicting
+   another page if no frame is free.  The returned frame is
+   pinned; the caller unpins it once the page's contents are in
+   place and the page table points at it.  Returns a null pointer
+   only if eviction is impossible (every frame pinned). */
+struct frame *
+frame_alloc (struct page *page)
+{
+  struct frame *f;
+
+  ASSERT (page != NULL);
+
+  lock_acquire (&frame_lock);
+  f = frame_get ();
+  if (f != NULL)
+    {
+      list_push_back (&f->pages, &page->frame_elem);
+      page->frame = f;
+    }
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Returns a frame for the read-only file page PAGE backed by
+   OFS within INODE, shared with any other process mapping the
+   same page.  Sets *CREATED to true if the frame is fresh and
+   the caller must fill in its contents and then call
+   frame_set_loaded(); false if the data is already present.  A
+   frame found mid-fill is not returned until its creator
+   finishes, so no sharer ever sees a partial load.  The frame is
+   pinned either way.  Returns a null pointer on failure. */
+struct frame *
+frame_alloc_shared (struct inode *inode, off_t ofs, struct page *page,
+                    bool *created)
+{
+  struct frame key, *f;
+  struct hash_elem *e;
+
+  ASSERT (inode != NULL && page != NULL && created != NULL);
+
+  lock_acquire (&frame_lock);
+
+  key.share_inode = inode;
+  key.share_ofs = ofs;
+  for (;;)
+    {
+      e = hash_find (&share_table, &key.share_elem);
+      if (e == NULL)
+        break;
+      f = hash_entry (e, struct frame, share_elem);
+      if (f->loaded)
+        {
+          f->pin_cnt++;
+          list_push_back (&f->pages, &page->frame_elem);
+          page->frame = f;
+          *created = false;
+          lock_release (&frame_lock);
+          return f;
+        }
+
+      /* Found, but its creator is still reading it in from disk.
+         Wait until the load finishes -- or fails, which frees the
+         frame -- and look again. */
+      cond_wait (&load_done, &frame_lock);
+    }
+
+  f = frame_get ();
+  if (f != NULL)
+    {
+      f->loaded = false;
+      f->shared = true;
+      f->share_inode = inode;
+      f->share_ofs = ofs;
+      hash_insert (&share_table, &f->share_elem);
+      list_push_back (&f->pages, &page->frame_elem);
+      page->frame = f;
+      *created = true;
+    }
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Attaches ADDED as a sharer of EXISTING's frame, tearing down
+   EXISTING's own mapping so that its next access refaults and
+   maps the frame read-only: this is how fork makes parent and
+   child share a frame copy-on-write.  A dirty mapping marks the
+   frame's sticky dirty bit first so eviction cannot mistake the
+   frame for clean once the hardware bit is gone.  Returns the
+   frame, or a null pointer if EXISTING is not resident. */
+struct frame *
+frame_attach (struct page *existing, struct page *added)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = existing->frame;
+  if (f != NULL)
+    {
+      uint32_t *pd = existing->owner->pagedir;
+
+      if (pagedir_is_dirty (pd, existing->uaddr))
+        f->dirty = true;
+      pagedir_clear_page (pd, existing->uaddr);
+      list_push_back (&f->pages, &added->frame_elem);
+      added->frame = f;
+    }
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Gives PAGE a frame of its own so that it can be mapped
+   writable: its current frame if PAGE is the only sharer, else a
+   fresh frame holding a copy of the contents.  PAGE's old
+   mapping is torn down; the returned frame is pinned for the
+   caller to map and unpin.  Returns a null pointer if PAGE is
+   not resident or no frame can be found for the copy. */
+struct frame *
+frame_unshare (struct page *page)
+{
+  struct frame *f, *copy;
+
+  lock_acquire (&frame_lock);
+  f = page->frame;
+  if (f == NULL)
+    {
+      lock_release (&frame_lock);
+      return NULL;
+    }
+
+  if (list_size (&f->pages) == 1)
+    {
+      f->pin_cnt++;
+      pagedir_clear_page (page->owner->pagedir, page->uaddr);
+      lock_release (&frame_lock);
+      return f;
+    }
+
+  /* Keep the shared frame from being evicted out from under the
+     copy. */
+  f->pin_cnt++;
+  copy = frame_get ();
+  f->pin_cnt--;
+  if (copy != NULL)
+    {
+      memcpy (copy->kaddr, f->kaddr, PGSIZE);
+      pagedir_clear_page (page->owner->pagedir, page->uaddr);
+      list_remove (&page->frame_elem);
+      list_push_back (&copy->pages, &page->frame_elem);
+      page->frame = copy;
+    }
+  lock_release (&frame_lock);
+  return copy;
+}
+
+/* Returns the number of pages sharing F's frame. */
+size_t
+frame_sharers (struct frame *f)
+{
+  size_t cnt;
+
+  lock_acquire (&frame_lock);
+  cnt = list_size (&f->pages);
+  lock_release (&frame_lock);
+  return cnt;
+}
+
+/* Releases PAGE's claim on its frame.  The frame itself is freed
+   once its last sharer lets go. */
+void
+frame_detach (struct page *page)
+{
+  struct frame *f = page->frame;
+
+  if (f == NULL)
+    return;
+
+  lock_acquire (&frame_lock);
+  list_remove (&page->frame_elem);
+  page->frame = NULL;
+  if (list_empty (&f->pages))
+    frame_release (f);
+  lock_release (&frame_lock);
+}
+
+/* Pins P's frame and returns it, or returns a null pointer if P
+   is not resident.  The residency check and the pin are one
+   atomic step under the frame lock: checking p->frame first and
+   pinning afterward would race with eviction, which can take the
+   frame and clear p->frame between the two. */
+struct frame *
+frame_pin_page (struct page *p)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = p->frame;
+  if (f != NULL)
+    f->pin_cnt++;
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Pins F so the eviction scan will skip it.  Pin frames around
+   I/O into or out of them.  Pins nest: the frame stays
+   unevictable until every pin is dropped. */
+void
+frame_pin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  f->pin_cnt++;
+  lock_release (&frame_lock);
+}
+
+/* Drops one pin on F; once the last pin is gone it is eligible
+   for eviction again. */
+void
+frame_unpin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Marks F's contents as in place and wakes any process that
+   found F in the share table while its creator was still filling
+   it. */
+void
+frame_set_loaded (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  f->loaded = true;
+  cond_broadcast (&load_done, &frame_lock);
+  lock_release (&frame_lock);
+}
+
+/* Waits until P is not in the middle of being evicted.  The
+   cleaner detaches a dirty victim's pages before it writes the
+   contents to swap, and does the writing without the frame lock
+   held; until a write finishes, its page reads as swap-backed
+   with no slot assigned.  Consuming p->swap_slot in that window
+   would lose the page, so the paths that fault P back in or free
+   it call this first.  A page never mid-eviction (the common
+   case) passes straight through. */
+void
+frame_wait_evicted (struct page *p)
+{
+  lock_acquire (&frame_lock);
+  while (p->frame == NULL && p->backing == PAGE_SWAP
+         && p->swap_slot == SWAP_SLOT_NONE)
+    cond_wait (&evict_done, &frame_lock);
+  lock_release (&frame_lock);
+}
+
+/* Obtains a free, pinned frame: from the user pool if it has
+   pages left, else from the cleaner's reserve, else by evicting
+   synchronously.  Returns a null pointer on complete failure.
+   The frame lock must be held. */
+static struct frame *
+frame_get (void)
+{
+  struct frame *f;
+  void *kaddr;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  kaddr = palloc_get_page (PAL_USER);
+  if (kaddr != NULL)
+    {
+      f = slab_alloc (frame_slab);
+      if (f == NULL)
+        {
+          palloc_free_page (kaddr);
+          return NULL;
+        }
+      f->kaddr = kaddr;
+      list_push_back (&frame_list, &f->elem);
+    }
+  else
+    {
+      /* Memory is full.  Prefer a frame the cleaner already
+         evicted; fall back to a synchronous eviction only when
+         the reserve is dry.  Either way, wake the cleaner to
+         restock. */
+      if (free_frame_cnt > 0)
+        {
+          f = list_entry (list_pop_front (&free_frames),
+                          struct frame, elem);
+          free_frame_cnt--;
+          list_push_back (&frame_list, &f->elem);
+        }
+      else
+        f = frame_evict ();
+
+      if (free_frame_cnt < FRAME_RESERVE_MIN)
+        {
+          cleaner_needed = true;
+          cond_signal (&cleaner_wakeup, &frame_lock);
+        }
+
+      if (f == NULL)
+        return NULL;
+    }
+
+  list_init (&f->pages);
+  f->pin_cnt = 1;
+  f->loaded = true;
+  f->dirty = false;
+  f->shared = false;
+  return f;
+}
+
+/* Destroys F, which must have no sharers left, returning its
+   page to the user pool.  The frame lock must be held. */
+static void
+frame_release (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (list_empty (&f->pages));
+
+  if (f->shared)
+    {
+      hash_delete (&share_table, &f->share_elem);
+      /* Waiters for this frame's load must look again: they will
+         miss in the share table now and create it themselves. */
+      cond_broadcast (&load_done, &frame_lock);
+    }
+  if (clock_hand == &f->elem)
+    clock_hand = list_next (clock_hand);
+  list_remove (&f->elem);
+  palloc_free_page (f->kaddr);
+  slab_free (frame_slab, f);
+}
+
+/* Advances the clock hand one step, wrapping around, and returns
+   the frame it lands on. */
+static struct frame *
+clock_next (void)
+{
+  if (clock_hand == list_end (&frame_list))
+    clock_hand = list_begin (&frame_list);
+  else
+    {
+      clock_hand = list_next (clock_hand);
+      if (clock_hand == list_end (&frame_list))
+        clock_hand = list_begin (&frame_list);
+    }
+  return list_entry (clock_hand, struct frame, elem);
+}
+
+/* Returns true if any sharer of F has touched it since the last
+   scan, clearing the accessed bits as a side effect. */
+static bool
+frame_test_and_clear_accessed (struct frame *f)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+
+      if (pagedir_is_accessed (p->owner->pagedir, p->uaddr))
+        {
+          pagedir_set_accessed (p->owner->pagedir, p->uaddr, false);
+          accessed = true;
+        }
+    }
+  return accessed;
+}
+
+/* Returns true if any sharer of F has dirtied it, now or through
+   a mapping that has since been torn down (the sticky bit set by
+   frame_attach()).  Frames in the share table are read-only and
+   never dirty. */
+static bool
+frame_is_dirty (struct frame *f)
+{
+  struct list_elem *e;
+
+  if (f->dirty)
+    return true;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+
+      if (pagedir_is_dirty (p->owner->pagedir, p->uaddr))
+        return true;
+    }
+  return false;
+}
+
+/* Picks a victim with the clock (second-chance) algorithm and
+   returns it, still holding its pages, or a null pointer if
+   every frame is pinned.  The frame lock must be held.
+
+   The first revolution gives every recently accessed frame a
+   second chance (clearing its accessed bit) and additionally
+   passes over dirty frames, because evicting a clean frame costs
+   nothing while a dirty one means a synchronous swap write.  A
+   frame that is neither accessed nor dirty is taken on sight.
+   If the first revolution finds nothing, the second accepts the
+   first unaccessed frame, dirty or not. */
+static struct frame *
+frame_select_victim (void)
+{
+  size_t frame_cnt = list_size (&frame_list);
+  size_t scanned;
+  int pass;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  if (frame_cnt == 0)
+    return NULL;
+
+  for (pass = 0; pass < 2; pass++)
+    for (scanned = 0; scanned < frame_cnt; scanned++)
+      {
+        struct frame *f = clock_next ();
+
+        if (f->pin_cnt > 0)
+          continue;
+        ASSERT (!list_empty (&f->pages));
+
+        if (frame_test_and_clear_accessed (f))
+          continue;
+        if (pass == 0 && frame_is_dirty (f))
+          continue;
+
+        return f;
+      }
+
+  return NULL;
+}
+
+/* Picks a victim, saves its contents, and returns the now-free
+   frame.  Returns a null pointer if every frame is pinned.  The
+   frame lock must be held; it is held across any swap write,
+   which is why this is only the last resort of frame_get() --
+   the cleaner restocks the reserve without that stall. */
+static struct frame *
+frame_evict (void)
+{
+  struct frame *f = frame_select_victim ();
+
+  if (f != NULL)
+    frame_save (f);
+  return f;
+}
+
+/* Unmaps F's page from every sharer and pushes the contents to
+   backing store if they would otherwise be lost.  Afterward F is
+   free for reuse (it stays on the clock list and keeps its
+   kaddr, but has no sharers and is unregistered from the share
+   table). */
+static void
+frame_save (struct frame *f)
+{
+  bool dirty = frame_is_dirty (f);
+
+  while (!list_empty (&f->pages))
+    {
+      struct page *p = list_entry (list_pop_front (&f->pages),
+                                   struct page, frame_elem);
+
+      pagedir_clear_page (p->owner->pagedir, p->uaddr);
+
+      if (dirty || p->backing == PAGE_SWAP)
+        {
+          /* Anything dirty, and anything that already lives in
+             swap, goes (back) to a swap slot.  Write-back of
+             dirty file-backed pages to their file is the mmap
+             layer's business at unmap time; eviction treats them
+             as anonymous.  Frames in the share table are
+             read-only and never take this path; a copy-on-write
+             frame with several sharers costs one slot per sharer,
+             which keeps slot ownership simple and only happens to
+             forked pages that were never written. */
+          ASSERT (!f->shared);
+          p->swap_slot = swap_out (f->kaddr);
+          p->backing = PAGE_SWAP;
+        }
+      /* Clean PAGE_FILE and PAGE_ZERO pages can be reloaded from
+         their backing store for free: nothing to write. */
+
+      p->frame = NULL;
+    }
+
+  if (f->shared)
+    {
+      hash_delete (&share_table, &f->share_elem);
+      f->shared = false;
+    }
+}
+
+/* Background cleaner.  Sleeps until an allocation signals memory
+   pressure, then evicts pages until the reserve of free frames
+   reaches FRAME_RESERVE_MAX, so that the swap writes for dirty
+   victims happen here instead of on some faulting thread's
+   critical path. */
+static void
+frame_cleaner (void *aux UNUSED)
+{
+  for (;;)
+    {
+      lock_acquire (&frame_lock);
+      while (!cleaner_needed)
+        cond_wait (&cleaner_wakeup, &frame_lock);
+      cleaner_needed = false;
+
+      /* Each eviction clears a victim's page table entry; batch
+         the TLB invalidations so restocking the reserve costs at
+         most one flush instead of one per victim.  The batch
+         stays open across the lock drops below: the pending
+         invalidations only matter once a user thread runs, and
+         process_activate() reloads CR3 on every switch to one. */
+      pagedir_begin_batch ();
+      while (free_frame_cnt < FRAME_RESERVE_MAX)
+        {
+          struct frame *f = frame_select_victim ();
+          struct list save_list;
+          bool dirty;
+
+          if (f == NULL)
+            break;
+
+          /* Detach the victim's sharers under the lock, but do
+             the swap writes with it released: holding it across
+             up to FRAME_RESERVE_MAX disk writes would park every
+             page fault in the system behind the whole batch,
+             which is exactly the stall the reserve exists to
+             avoid.  The victim stays pinned so no other evictor
+             takes it; each dirty page is marked swap-backed with
+             no slot assigned yet, and the paths that consume
+             p->swap_slot wait that state out in
+             frame_wait_evicted().  Detaching every page before
+             the first write also keeps a refault from remapping
+             the frame mid-eviction: once p->frame is cleared,
+             frame_pin_page() cannot find it. */
+          f->pin_cnt++;
+          dirty = frame_is_dirty (f);
+          if (f->shared)
+            {
+              hash_delete (&share_table, &f->share_elem);
+              cond_broadcast (&load_done, &frame_lock);
+              f->shared = false;
+            }
+          list_init (&save_list);
+          while (!list_empty (&f->pages))
+            {
+              struct page *p = list_entry (list_pop_front (&f->pages),
+                                           struct page, frame_elem);
+
+              pagedir_clear_page (p->owner->pagedir, p->uaddr);
+              p->frame = NULL;
+              if (dirty || p->backing == PAGE_SWAP)
+                {
+                  p->backing = PAGE_SWAP;
+                  p->swap_slot = SWAP_SLOT_NONE;
+                  list_push_back (&save_list, &p->frame_elem);
+                }
+              /* Clean PAGE_FILE and PAGE_ZERO pages reload from
+                 their backing store for free: nothing to write. */
+            }
+
+          while (!list_empty (&save_list))
+            {
+              struct page *p = list_entry (list_pop_front (&save_list),
+                                           struct page, frame_elem);
+              swap_slot_t slot;
+
+              lock_release (&frame_lock);
+              slot = swap_out (f->kaddr);
+              lock_acquire (&frame_lock);
+              p->swap_slot = slot;
+              cond_broadcast (&evict_done, &frame_lock);
+            }
+
+          f->pin_cnt--;
+          if (clock_hand == &f->elem)
+            clock_hand = list_next (clock_hand);
+          list_remove (&f->elem);
+          list_push_back (&free_frames, &f->elem);
+          free_frame_cnt++;
+        }
+      pagedir_end_batch ();
+      lock_release (&frame_lock);
+    }
+}
+
+/* Share table hash function: mixes the inode pointer and
+   offset. */
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, share_elem);
+
+  return hash_bytes (&f->share_inode, sizeof f->share_inode)
+         ^ hash_int (f->share_ofs);
+}
+
+/* Share table ordering: by (inode, offset). */
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, share_elem);
+  const struct frame *b = hash_entry (b_, struct frame, share_elem);
+
+  if (a->share_inode != b->share_inode)
+    return a->share_inode < b->share_inode;
+  return a->share_ofs < b->share_ofs;
+}
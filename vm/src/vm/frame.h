@@ -0,0 +1,56 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include "filesys/off_t.h"
+
+struct inode;
+struct page;
+
+/* A physical frame holding a user page.  One entry exists per
+   frame handed out by palloc's user pool.
+
+   A frame normally backs a single page, but read-only file-backed
+   pages of the same (inode, offset) share one frame across
+   processes; every sharer sits on `pages' and the frame is
+   registered in the share table under its backing store key.
+   Fork adds a second kind of sharing: parent and child map the
+   same frame read-only until one of them writes, at which point
+   the writer gets a private copy (see frame_unshare()). */
+struct frame
+  {
+    void *kaddr;                /* Kernel virtual address of the frame. */
+    struct list pages;          /* Pages mapped to this frame. */
+    unsigned pin_cnt;           /* Pins held; a pinned frame is never
+                                   evicted.  A count, not a flag: sharers
+                                   pin independently. */
+    bool loaded;                /* Contents in place?  False only while a
+                                   shared frame's creator is still reading
+                                   it in (see frame_set_loaded()). */
+    bool dirty;                 /* Dirtied before a mapping was torn down. */
+    struct list_elem elem;      /* Element in the clock list. */
+
+    /* Sharing, valid while `shared' is true. */
+    bool shared;                /* Registered in the share table? */
+    struct inode *share_inode;  /* Backing inode... */
+    off_t share_ofs;            /* ...and offset therein. */
+    struct hash_elem share_elem;/* Element in the share table. */
+  };
+
+void frame_init (void);
+struct frame *frame_alloc (struct page *);
+struct frame *frame_alloc_shared (struct inode *, off_t, struct page *,
+                                  bool *created);
+struct frame *frame_attach (struct page *existing, struct page *added);
+struct frame *frame_unshare (struct page *);
+size_t frame_sharers (struct frame *);
+void frame_detach (struct page *);
+struct frame *frame_pin_page (struct page *);
+void frame_pin (struct frame *);
+void frame_unpin (struct frame *);
+void frame_set_loaded (struct frame *);
+void frame_wait_evicted (struct page *);
+
+#endif /* vm/frame.h */
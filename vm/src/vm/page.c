@@ -0,0 +1,390 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+static unsigned page_hash (const struct hash_elem *, void *);
+static bool page_less (const struct hash_elem *, const struct hash_elem *,
+                       void *);
+static void page_destroy (struct hash_elem *, void *);
+
+/* Cache of struct page records, shared by all processes.
+   Created when the first address space is set up; the first
+   process is started by the main thread before any other user
+   thread exists, so lazy creation does not race. */
+static struct slab *page_slab;
+static bool page_load (struct page *);
+
+/* Initializes the current thread's supplemental page table.
+   Called when a process's address space is set up. */
+void
+page_spt_init (void)
+{
+  if (page_slab == NULL)
+    {
+      page_slab = slab_create ("page", sizeof (struct page));
+      if (page_slab == NULL)
+        PANIC ("couldn't create page slab");
+    }
+  hash_init (&thread_current ()->spt, page_hash, page_less, NULL);
+}
+
+/* Tears down the current thread's supplemental page table,
+   releasing every page's frame and swap slot.  Called at process
+   exit. */
+void
+page_spt_destroy (void)
+{
+  hash_destroy (&thread_current ()->spt, page_destroy);
+}
+
+/* Duplicates PARENT's address space into the current thread's,
+   for fork.  Resident pages are not copied: the child attaches
+   to the parent's frame and both map it read-only from then on,
+   deferring the copy to the first write (page_unshare()).  Pages
+   out in swap get their own slot holding a copy, and file-backed
+   executable pages point at the child's own handle on the
+   executable.  Memory mappings are not inherited, matching the
+   rest of the mmap machinery, which ties a mapping's pages to a
+   file handle that only the mapping process holds.
+
+   The caller guarantees that PARENT is blocked until this
+   returns.  Returns true on success, false if memory or swap is
+   exhausted partway (the child's exit path cleans up whatever
+   was built). */
+bool
+page_spt_duplicate (struct thread *parent)
+{
+  struct hash_iterator i;
+
+  hash_first (&i, &parent->spt);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, elem);
+      struct page *c;
+
+      if (p->file != NULL && p->file != parent->exe)
+        continue;               /* mmap page; not inherited. */
+
+      c = page_allocate (p->uaddr, p->writable);
+      if (c == NULL)
+        return false;
+      c->backing = p->backing;
+      if (p->backing == PAGE_FILE)
+        page_set_file (c, thread_current ()->exe, p->file_ofs,
+                       p->read_bytes);
+
+      if (frame_attach (p, c) == NULL)
+        {
+          /* Not resident: the contents live in the backing
+             store.  Wait out any eviction still writing P to
+             swap, then reload P's backing in case eviction moved
+             it there since the copy above. */
+          frame_wait_evicted (p);
+          c->backing = p->backing;
+          if (c->backing == PAGE_SWAP)
+            {
+              void *bounce = palloc_get_page (0);
+
+              if (bounce == NULL)
+                return false;
+              swap_read (p->swap_slot, bounce);
+              c->swap_slot = swap_out (bounce);
+              palloc_free_page (bounce);
+            }
+        }
+    }
+  return true;
+}
+
+/* Creates a supplemental page table entry for the page at UADDR
+   in the current process, initially zero-filled, and returns it.
+   Returns a null pointer if UADDR is already mapped or memory is
+   exhausted. */
+struct page *
+page_allocate (void *uaddr, bool writable)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  ASSERT (pg_ofs (uaddr) == 0);
+
+  p = slab_alloc (page_slab);
+  if (p == NULL)
+    return NULL;
+
+  p->uaddr = uaddr;
+  p->owner = t;
+  p->writable = writable;
+  p->backing = PAGE_ZERO;
+  p->file = NULL;
+  p->file_ofs = 0;
+  p->read_bytes = 0;
+  p->swap_slot = SWAP_SLOT_NONE;
+  p->frame = NULL;
+
+  if (hash_insert (&t->spt, &p->elem) != NULL)
+    {
+      slab_free (page_slab, p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Makes P a file-backed page: READ_BYTES bytes from OFS within
+   FILE, with the remainder of the page zero-filled. */
+void
+page_set_file (struct page *p, struct file *file, off_t ofs,
+               size_t read_bytes)
+{
+  ASSERT (p != NULL && file != NULL);
+  ASSERT (read_bytes <= PGSIZE);
+
+  p->backing = PAGE_FILE;
+  p->file = file;
+  p->file_ofs = ofs;
+  p->read_bytes = read_bytes;
+}
+
+/* Returns the current process's page containing UADDR, or a null
+   pointer if there is none. */
+struct page *
+page_lookup (const void *uaddr)
+{
+  struct page key;
+  struct hash_elem *e;
+
+  key.uaddr = (void *) pg_round_down (uaddr);
+  e = hash_find (&thread_current ()->spt, &key.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+/* Faults in the page containing FAULT_ADDR for the current
+   process.  Returns true on success, false if FAULT_ADDR is not
+   part of the process's address space or memory is exhausted.
+
+   A writable page whose frame has other sharers is mapped
+   read-only: it is a copy-on-write page from fork, and the
+   write fault on it goes to page_unshare(). */
+bool
+page_in (void *fault_addr)
+{
+  struct page *p = page_lookup (fault_addr);
+  struct frame *f;
+  bool writable;
+
+  if (p == NULL)
+    return false;
+
+  /* Pin the resident frame, or load the page into a fresh pinned
+     one.  A resident page (e.g. left unmapped by fork's
+     frame_attach) must be pinned in the same breath as the
+     residency check: eviction could otherwise take the frame
+     while this path blocks on the frame lock further down. */
+  f = frame_pin_page (p);
+  if (f == NULL)
+    {
+      if (!page_load (p))
+        return false;
+      f = p->frame;
+    }
+
+  writable = p->writable && frame_sharers (f) == 1;
+  if (!pagedir_set_page (p->owner->pagedir, p->uaddr, f->kaddr, writable))
+    {
+      frame_unpin (f);
+      return false;
+    }
+  frame_unpin (f);
+  return true;
+}
+
+/* Resolves a write fault on the read-only mapping of writable
+   page FAULT_ADDR by giving the page a private, writably mapped
+   frame (the copy-on-write copy).  Returns false if FAULT_ADDR
+   is not a writable page of the current process or memory is
+   exhausted. */
+bool
+page_unshare (void *fault_addr)
+{
+  struct page *p = page_lookup (fault_addr);
+  struct frame *f;
+
+  if (p == NULL || !p->writable)
+    return false;
+
+  f = frame_unshare (p);
+  if (f == NULL)
+    {
+      /* The frame was evicted between the fault and now; a
+         fresh fault-in suffices, since eviction gave the page a
+         private swap slot. */
+      return p->frame == NULL && page_in (fault_addr);
+    }
+
+  if (!pagedir_set_page (p->owner->pagedir, p->uaddr, f->kaddr, true))
+    {
+      frame_unpin (f);
+      return false;
+    }
+  frame_unpin (f);
+  return true;
+}
+
+/* Removes file-backed page P from its process's address space at
+   munmap time, writing its contents back to the file if they
+   were dirtied.  Clean pages are dropped without I/O: the file
+   already holds their contents.  A page that was evicted to swap
+   while mapped is paged back in first so its modifications reach
+   the file. */
+void
+page_unmap (struct page *p)
+{
+  ASSERT (p->backing == PAGE_FILE || p->backing == PAGE_SWAP);
+
+  frame_wait_evicted (p);
+  if (p->backing == PAGE_SWAP)
+    {
+      /* Dirtied, evicted, and not touched since: pull it back to
+         write it to the file. */
+      struct frame *f = frame_alloc (p);
+
+      if (f != NULL)
+        {
+          swap_in (p->swap_slot, f->kaddr);
+          p->swap_slot = SWAP_SLOT_NONE;
+          p->backing = PAGE_FILE;
+          file_write_at (p->file, f->kaddr, p->read_bytes, p->file_ofs);
+        }
+    }
+  else if (p->frame != NULL
+           && pagedir_is_dirty (p->owner->pagedir, p->uaddr))
+    file_write_at (p->file, p->frame->kaddr, p->read_bytes, p->file_ofs);
+
+  page_free (p);
+}
+
+/* Removes P from its process's address space, releasing its
+   frame and swap slot. */
+void
+page_free (struct page *p)
+{
+  hash_delete (&p->owner->spt, &p->elem);
+  page_destroy (&p->elem, NULL);
+}
+
+/* Brings P's contents into a frame.  Read-only file pages attach
+   to the shared frame for their (inode, offset) when one exists,
+   so twenty instances of a binary share one copy of its text.
+   The frame is left pinned for the caller to map and unpin. */
+static bool
+page_load (struct page *p)
+{
+  struct frame *f;
+  bool fresh_shared = false;
+
+  /* If the cleaner evicted P but is still writing it to swap,
+     P's slot is not valid yet; wait for the write to finish. */
+  frame_wait_evicted (p);
+
+  if (p->backing == PAGE_FILE && !p->writable)
+    {
+      bool created;
+
+      f = frame_alloc_shared (file_get_inode (p->file), p->file_ofs,
+                              p, &created);
+      if (f == NULL)
+        return false;
+      if (!created)
+        return true;            /* Another process already read it in. */
+      fresh_shared = true;
+    }
+  else
+    {
+      f = frame_alloc (p);
+      if (f == NULL)
+        return false;
+    }
+
+  switch (p->backing)
+    {
+    case PAGE_ZERO:
+      memset (f->kaddr, 0, PGSIZE);
+      break;
+
+    case PAGE_FILE:
+      if (file_read_at (p->file, f->kaddr, p->read_bytes, p->file_ofs)
+          != (off_t) p->read_bytes)
+        {
+          frame_detach (p);
+          return false;
+        }
+      memset ((uint8_t *) f->kaddr + p->read_bytes, 0,
+              PGSIZE - p->read_bytes);
+      break;
+
+    case PAGE_SWAP:
+      swap_in (p->swap_slot, f->kaddr);
+      p->swap_slot = SWAP_SLOT_NONE;
+      /* Once read back in, the copy in memory is the only one;
+         the next eviction will write it out again. */
+      break;
+
+    default:
+      NOT_REACHED ();
+    }
+
+  /* A freshly created shared frame was visible in the share
+     table all through the read above; release anyone who found
+     it there and has been waiting for the contents. */
+  if (fresh_shared)
+    frame_set_loaded (f);
+
+  return true;
+}
+
+/* hash_destroy() callback: releases one page's resources. */
+static void
+page_destroy (struct hash_elem *e, void *aux UNUSED)
+{
+  struct page *p = hash_entry (e, struct page, elem);
+
+  /* The page and its swap slot cannot be released while the
+     cleaner is still writing its contents out. */
+  frame_wait_evicted (p);
+  if (p->frame != NULL)
+    {
+      pagedir_clear_page (p->owner->pagedir, p->uaddr);
+      frame_detach (p);
+    }
+  if (p->backing == PAGE_SWAP)
+    swap_free (p->swap_slot);
+  slab_free (page_slab, p);
+}
+
+/* Hashes the user address of the page E embeds. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, elem);
+
+  return hash_bytes (&p->uaddr, sizeof p->uaddr);
+}
+
+/* Orders pages by user address. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, elem);
+  const struct page *b = hash_entry (b_, struct page, elem);
+
+  return a->uaddr < b->uaddr;
+}
@@ -0,0 +1,54 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include "filesys/off_t.h"
+#include "vm/swap.h"
+
+struct file;
+struct frame;
+struct thread;
+
+/* Where a page's contents live when it is not resident. */
+enum page_backing
+  {
+    PAGE_ZERO,          /* All zeros; nothing to load. */
+    PAGE_FILE,          /* Read from (and maybe written back to) a file. */
+    PAGE_SWAP           /* Stored in a swap slot. */
+  };
+
+/* A supplemental page table entry: one user virtual page of one
+   process.  Lives in the owning thread's `spt' hash, keyed by
+   user address. */
+struct page
+  {
+    void *uaddr;                /* User virtual address (page-aligned). */
+    struct thread *owner;       /* Owning thread. */
+    bool writable;              /* Writable by user programs? */
+
+    enum page_backing backing;  /* Where contents live when not resident. */
+    struct file *file;          /* PAGE_FILE: backing file... */
+    off_t file_ofs;             /* ...offset therein... */
+    size_t read_bytes;          /* ...bytes to read (rest is zeros). */
+    swap_slot_t swap_slot;      /* PAGE_SWAP: slot holding contents. */
+
+    struct frame *frame;        /* Resident frame, or null pointer. */
+    struct list_elem frame_elem;/* Element in frame's sharer list. */
+    struct hash_elem elem;      /* Element in owner's spt. */
+  };
+
+void page_spt_init (void);
+void page_spt_destroy (void);
+bool page_spt_duplicate (struct thread *parent);
+
+struct page *page_allocate (void *uaddr, bool writable);
+void page_set_file (struct page *, struct file *, off_t, size_t read_bytes);
+struct page *page_lookup (const void *uaddr);
+bool page_in (void *fault_addr);
+bool page_unshare (void *fault_addr);
+void page_unmap (struct page *);
+void page_free (struct page *);
+
+#endif /* vm/page.h */
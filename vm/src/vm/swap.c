@@ -0,0 +1,90 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Sectors making up one page-sized swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* The swap device, or a null pointer if none is attached. */
+static struct block *swap_device;
+
+/* In-use map of swap slots. */
+static struct bitmap *swap_map;
+static struct lock swap_lock;
+
+/* Initializes the swap subsystem.  A missing swap device is not
+   an error until someone actually needs to swap. */
+void
+swap_init (void)
+{
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    return;
+
+  swap_map = bitmap_create (block_size (swap_device) / SECTORS_PER_SLOT);
+  if (swap_map == NULL)
+    PANIC ("couldn't allocate swap bitmap");
+  lock_init (&swap_lock);
+}
+
+/* Writes the page at KADDR to a free swap slot and returns the
+   slot number.  Panics if swap is full or absent: by the time a
+   page must leave memory there is nowhere else for it to go. */
+swap_slot_t
+swap_out (const void *kaddr)
+{
+  swap_slot_t slot;
+
+  if (swap_device == NULL)
+    PANIC ("swap_out: no swap device");
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_map, 0, 1, false);
+  lock_release (&swap_lock);
+  if (slot == BITMAP_ERROR)
+    PANIC ("swap_out: swap is full");
+
+  block_write_multiple (swap_device, slot * SECTORS_PER_SLOT, kaddr,
+                        SECTORS_PER_SLOT);
+  return slot;
+}
+
+/* Reads the page stored in SLOT into KADDR and releases the
+   slot. */
+void
+swap_in (swap_slot_t slot, void *kaddr)
+{
+  swap_read (slot, kaddr);
+  swap_free (slot);
+}
+
+/* Reads the page stored in SLOT into KADDR, leaving the slot
+   allocated.  Used to copy a swapped-out page at fork time. */
+void
+swap_read (swap_slot_t slot, void *kaddr)
+{
+  ASSERT (swap_device != NULL);
+  ASSERT (bitmap_test (swap_map, slot));
+
+  block_read_multiple (swap_device, slot * SECTORS_PER_SLOT, kaddr,
+                       SECTORS_PER_SLOT);
+}
+
+/* Releases SLOT without reading it back, e.g. because its owner
+   exited. */
+void
+swap_free (swap_slot_t slot)
+{
+  if (slot == SWAP_SLOT_NONE)
+    return;
+
+  ASSERT (swap_device != NULL);
+
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_map, slot));
+  bitmap_reset (swap_map, slot);
+  lock_release (&swap_lock);
+}
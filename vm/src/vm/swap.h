@@ -0,0 +1,18 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+
+/* An index identifying a page-sized slot on the swap device. */
+typedef size_t swap_slot_t;
+
+/* Marks a page with no swap slot assigned. */
+#define SWAP_SLOT_NONE ((swap_slot_t) -1)
+
+void swap_init (void);
+swap_slot_t swap_out (const void *kaddr);
+void swap_in (swap_slot_t, void *kaddr);
+void swap_read (swap_slot_t, void *kaddr);
+void swap_free (swap_slot_t);
+
+#endif /* vm/swap.h */